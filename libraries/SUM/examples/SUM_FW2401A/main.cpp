@@ -11,14 +11,15 @@
 
 /**********
  * This firmware is written for ATtiny1616.
- * The generated binary code will be less than 1KiB.
- * You can use it as is with t416/t816.
+ * The reset sequencer no longer keeps the binary code under 1KiB,
+ * but the default build can still be used as is with t416/t816.
+ * ENABLE_UPDI_ACCEL is dropped there, as it does not fit their SRAM.
  * But other than that it doesn't work out of the box.
  */
 
 #include <avr/io.h>
 #include <api/macro_api.h>
-#include <api/power.h>
+#include <avr/sleep.h>
 #include <peripheral.h>
 
 /* Operating frequency must be 10MHz or less for 3.3V operation. */
@@ -27,10 +28,28 @@
 #endif
 #define F_CPU 10000000L
 
+/* Counts the traffic of both directions and reports it on a host BREAK. */
+/* The MCU then stays in idle sleep instead of standby.                  */
+// #define ENABLE_TRAFFIC_REPORT
+
+/* UPDI mode runs the accelerator command set instead of the pass-through. */
+/* SerialUPDI of avrdude does not work in this mode.                       */
+/* Its 518 bytes of buffers need SRAM 1KB or more (not t416/t816).         */
+// #define ENABLE_UPDI_ACCEL
+
+#if defined(ENABLE_UPDI_ACCEL) && (INTERNAL_SRAM_SIZE < 1024)
+  #warning ENABLE_UPDI_ACCEL is ignored with less than SRAM 1KB
+  #undef ENABLE_UPDI_ACCEL
+#endif
+
 #define LED_DELAY 400       /* MAX=65535 */
 #define UPDI_BAUD (225000)  /* MAX=225000 */
 #define UPDI_BREAK (4500)   /* this must be slow enough */
 #define UPDI_USART_ON     ( USART_ODME_bm | USART_TXEN_bm )
+#define UPDI_USART_CTRLA  ( USART_LBME_bm | USART_RS485_INT_gc )
+#define RESET_TICK (97)     /* 10ms at CLK_TCA, MAX=65535 */
+#define REPORT_BAUD (115200)  /* the host must listen at this rate */
+#define ACCEL_BAUD (500000)   /* host side of the accelerator, 8N1 */
 #define LED_ON ( PORT_ISC_INPUT_DISABLE_gc | PORT_INVEN_bm )
 #define PORTMUX_CTRLA_DEF ( PORTMUX_LUT0_ALTERNATE_gc \
                           | PORTMUX_LUT1_DEFAULT_gc \
@@ -83,6 +102,11 @@ void setup_system (void) {
   // pinControlRegister(PIN_PC2) = pin_res; // I:TDAT:async_in (DUP)
   pinControlRegister(PIN_PC3) = pin_pup;    // I:TxD:LUT1_IN0:sense (DUP)
 
+#ifdef ENABLE_TRAFFIC_REPORT
+  /* RxD is also sensed by the traffic counter */
+  pinControlRegister(PIN_PB2) = PORT_ISC_INTDISABLE_gc;
+#endif
+
   /* output only pin */
   openDrainWriteMacro(PIN_PA3, LOW);
   openDrainWriteMacro(PIN_PA7, LOW);
@@ -123,11 +147,26 @@ void setup_peripheral (void) {
   EVSYS_ASYNCUSER3  = EVSYS_ASYNCUSER3_ASYNCCH0_gc;
   EVSYS_ASYNCUSER11 = EVSYS_ASYNCUSER11_ASYNCCH1_gc;
 
+#ifdef ENABLE_TRAFFIC_REPORT
+  /**********
+   * EVSYS_SYNCCH0 <- PC3:TxD --- host to target
+   * EVSYS_SYNCCH1 <- PB2:RxD --- target to host (either mode)
+   *
+   * EVSYS_SYNCUSER0:TCA0 <- EVSYS_SYNCCH0 or EVSYS_SYNCCH1
+   *
+   * TCA0 is the only event counter, so the RTC PIT
+   * swaps the direction every window.
+   */
+  EVSYS_SYNCCH0 = EVSYS_SYNCCH0_PORTC_PIN3_gc;
+  EVSYS_SYNCCH1 = EVSYS_SYNCCH1_PORTB_PIN2_gc;
+  EVSYS_SYNCUSER0 = EVSYS_SYNCUSER0_SYNCCH0_gc;
+#endif
+
   /**********
    * USART0 - updi reset sender for UART mode
    */
   USART0_BAUD  = ((F_CPU / UPDI_BAUD * 8 + 1) / 2);
-  USART0_CTRLA = ( USART_LBME_bm | USART_RS485_INT_gc );
+  USART0_CTRLA = UPDI_USART_CTRLA;
   USART0_CTRLC = ( USART_CHSIZE_8BIT_gc \
                  | USART_PMODE_EVEN_gc \
                  | USART_CMODE_ASYNCHRONOUS_gc \
@@ -143,6 +182,26 @@ void setup_peripheral (void) {
   TCA0_SINGLE_CTRLA = TCA_SINGLE_ENABLE_bm
                     | TCA_SINGLE_CLKSEL_DIV1024_gc;
 
+#ifdef ENABLE_TRAFFIC_REPORT
+  /**********
+   * TCA - traffic counter
+   *
+   * The counter counts rising edges of the selected direction
+   * instead of CLK_TCA. The prescaler keeps feeding the TCBs.
+   */
+  TCA0_SINGLE_EVCTRL = TCA_SINGLE_CNTEI_bm | TCA_SINGLE_EVACT_POSEDGE_gc;
+
+  /**********
+   * RTC - traffic window
+   *
+   * CLK_RTC = 1024Hz (INT1K), PIT = 8Hz
+   */
+  RTC_CLKSEL = RTC_CLKSEL_INT1K_gc;
+  while (RTC_PITSTATUS);
+  RTC_PITINTCTRL = RTC_PI_bm;
+  RTC_PITCTRLA = RTC_PERIOD_CYC128_gc | RTC_PITEN_bm;
+#endif
+
   /**********
    * TCB - LED off time delay
    *
@@ -166,6 +225,19 @@ void setup_peripheral (void) {
   TCB1_CTRLB  = TCB_CNTMODE_SINGLE_gc | TCB_CCMPEN_bm | TCB_ASYNC_bm;
   TCB1_CTRLA  = TCB_ENABLE_bm | TCB_CLKSEL_TCA0_gc | TCB_RUNSTDBY_bm;
 
+  /**********
+   * TCB - reset sequencer tick
+   *
+   * TCB0_MODE <- INT (periodic)
+   * TCB0_CCMP <- 10ms
+   *
+   * The interrupt is enabled only while the reset sequencer
+   * waits for the target or for SW1 to be released.
+   */
+  TCB0_CCMP   = RESET_TICK;
+  TCB0_CTRLB  = TCB_CNTMODE_INT_gc;
+  TCB0_CTRLA  = TCB_ENABLE_bm | TCB_CLKSEL_TCA0_gc;
+
   /**********
    * CCL0 - Activity logic synthesis
    *
@@ -221,11 +293,73 @@ bool is_pass_through_mode_of_uart (void) {
   }
 }
 
+#ifdef ENABLE_UPDI_ACCEL
+/**********
+ * UPDI accelerator : USART0 configuration
+ *
+ * There is only one USART, so it is swapped between the host side
+ * (PB3:TxD in, PB2:RxD out) and the target side (PA1:TDAT) for each
+ * command. The host waits for the answer before the next command.
+ */
+volatile bool accel_mode;
+volatile bool accel_busy;
+
+void accel_host (void) {
+  USART0_CTRLB = 0;
+  PORTMUX_CTRLB = 0;                  // USART0_TxD -> PB2
+  USART0_BAUD  = ((F_CPU / ACCEL_BAUD * 8 + 1) / 2);
+  USART0_CTRLA = 0;
+  USART0_CTRLC = ( USART_CHSIZE_8BIT_gc \
+                 | USART_PMODE_DISABLED_gc \
+                 | USART_CMODE_ASYNCHRONOUS_gc \
+                 | USART_SBMODE_1BIT_gc );
+  USART0_CTRLB = USART_RXEN_bm | USART_TXEN_bm;
+}
+
+void accel_target (void) {
+  USART0_CTRLB = 0;
+  PORTMUX_CTRLB = PORTMUX_USART0_ALTERNATE_gc;  // USART0_TxD -> PA1
+  USART0_BAUD  = ((F_CPU / UPDI_BAUD * 8 + 1) / 2);
+  USART0_CTRLA = UPDI_USART_CTRLA;
+  USART0_CTRLC = ( USART_CHSIZE_8BIT_gc \
+                 | USART_PMODE_EVEN_gc \
+                 | USART_CMODE_ASYNCHRONOUS_gc \
+                 | USART_SBMODE_2BIT_gc );
+  USART0_CTRLB = UPDI_USART_ON | USART_RXEN_bm;
+}
+
+void accel_enter (void) {
+  /* The CCL must not drive TDAT or HTCR */
+  CCL_CTRLA = 0;
+  EVSYS_ASYNCUSER9 = EVSYS_ASYNCUSER9_OFF_gc;
+  PORTMUX_CTRLA = PORTMUX_CTRLA_DEF & ~PORTMUX_EVOUT1_bm;
+  openDrainWriteMacro(PIN_PC1, HIGH); // TDAT opendrain input
+  pinControlRegister(PIN_PB3) = PORT_ISC_INTDISABLE_gc | PORT_PULLUPEN_bm;
+  PORTB_OUTSET = PIN2_bm;             // RxD idles HIGH between answers
+  accel_host();
+  accel_mode = true;
+}
+
+void accel_leave (void) {
+  if (!accel_mode) return;
+  accel_mode = false;
+  USART0_CTRLB = 0;
+  accel_target();
+  USART0_CTRLB = 0;
+  PORTB_OUTCLR = PIN2_bm;
+  pinControlRegister(PIN_PB3) = PORT_ISC_INPUT_DISABLE_gc;
+  CCL_CTRLA = CCL_ENABLE_bm | CCL_RUNSTDBY_bm;  // CCL restart
+}
+#endif
+
 /*********
  * Configure the multiplexer/demultiplexer depending on the operating mode
  */
 void switch_pass_through_mode (void) {
   if (is_pass_through_mode_of_uart()) {
+#ifdef ENABLE_UPDI_ACCEL
+    accel_leave();
+#endif
     /* PC3:TxD -> PA7:HTCR */
     /* PA6:HRCT -> PB2:RxD */
     PORTMUX_CTRLA = PORTMUX_CTRLA_DEF;
@@ -233,11 +367,15 @@ void switch_pass_through_mode (void) {
     EVSYS_ASYNCUSER9 = EVSYS_ASYNCUSER9_ASYNCCH0_gc;
   }
   else {
+#ifdef ENABLE_UPDI_ACCEL
+    accel_enter();
+#else
     /* PC3:TxD -> PC1:TDAT */
     /* PC2:TDAT -> PB2:RxD */
     PORTMUX_CTRLA = PORTMUX_CTRLA_ALT;
     openDrainWriteMacro(PIN_PC1, LOW);  // TDAT opendrain output
     EVSYS_ASYNCUSER9 = EVSYS_ASYNCUSER9_ASYNCCH2_gc;
+#endif
   }
 }
 
@@ -248,23 +386,100 @@ void switch_pass_through_mode (void) {
 //   return GPIO_GPIOR0 = USART0_RXDATAL;
 // }
 
+/**********
+ * UPDI reset sequencer
+ *
+ * The reset runs as a state machine on USART0 and TCB0 interrupts.
+ * In UART mode the pass-through keeps working during the reset,
+ * so the first output of a bootloader is not lost.
+ * In UPDI mode TDAT is detached from the host until the end.
+ * DTR and RTS edges arriving meanwhile are applied at the end.
+ */
+enum reset_state_e {
+    RESET_IDLE = 0
+  , RESET_BREAK     /* slow 0x00 is on the wire */
+  , RESET_SETUP     /* the target has not released TDAT yet */
+  , RESET_ASSERT    /* RSTREQ is being sent */
+  , RESET_HOLD      /* SW1 is still pressed */
+  , RESET_RELEASE   /* NOP and UPDIDIS are being sent */
+  , RESET_REPORT    /* a traffic report is being sent */
+};
+
+volatile uint8_t reset_state;
+volatile bool reset_again;    /* RTS came during a sequence */
+volatile bool reset_sw1_again; /* SW1 came during a sequence */
+bool reset_by_sw1;            /* hold while pressed, then reboot */
+const uint8_t *reset_ptr;
+uint8_t reset_left;
+uint8_t reset_blink;
+uint8_t reset_ctrla = UPDI_USART_CTRLA;
+
+#ifdef ENABLE_TRAFFIC_REPORT
+/* Edges counted in each direction, each one half of the time */
+uint32_t traffic_tx;
+uint32_t traffic_rx;
+uint32_t traffic_windows;
+uint16_t traffic_resets;
+uint16_t traffic_dropped;   /* RTS while a reset was already queued */
+uint16_t traffic_breaks;
+bool traffic_low;           /* TxD was low when its window started */
+char traffic_line[80];
+#endif
+
+const uint8_t updi_assert[] = {
+    0x55        // UPDI_SYNCH
+  , 0xC8        // UPDI_STCS | UPDI_CS_ASI_RESET_REQ
+  , 0x59        // UPDI_RSTREQ
+};
+const uint8_t updi_release[] = {
+    0x55        // UPDI_SYNCH
+  , 0xC8        // UPDI_STCS | UPDI_CS_ASI_RESET_REQ
+  , 0x00        // UPDI_NOP
+  , 0x55        // UPDI_SYNCH
+  , 0xC3        // UPDI_STCS | UPDI_CS_CTRLB
+  , 0x04        // UPDI_SET_UPDIDIS
+};
+
 /**********
  * UPDI communication is implemented as a single wire UART
+ * The bytes are fed by USART0_DRE, the end comes with USART0_TXC.
  */
-void updi_send (uint8_t _data) {
-  loop_until_bit_is_set(USART0_STATUS, USART_DREIF_bp);
-  USART0_STATUS  = USART_TXCIF_bm;
-  USART0_TXDATAL = _data;
+void updi_send (const uint8_t *_data, uint8_t _len, uint8_t _state) {
+  reset_state = _state;
+  reset_ptr = _data;
+  reset_left = _len;
+  USART0_CTRLA = reset_ctrla | USART_TXCIE_bm | USART_DREIE_bm;
 }
 
 /**********
  * Reset the target AVR via UPDI communication
  */
-void send_reset_updi (void) {
+void reset_start (void) {
+#ifdef ENABLE_UPDI_ACCEL
+  if (reset_state != RESET_IDLE || accel_busy) {
+#else
+  if (reset_state != RESET_IDLE) {
+#endif
+#ifdef ENABLE_TRAFFIC_REPORT
+    if (reset_again) traffic_dropped++;
+#endif
+    reset_again = true;
+    return;
+  }
+#ifdef ENABLE_TRAFFIC_REPORT
+  traffic_resets++;
+#endif
+#ifdef ENABLE_UPDI_ACCEL
+  accel_leave();
+#endif
   openDrainWriteMacro(PIN_PA5, LOW);  // TRST negate (LOW)
 
-  EVSYS_ASYNCUSER9 = EVSYS_ASYNCUSER9_OFF_gc;
-  PORTMUX_CTRLA = PORTMUX_CTRLA_DEF;  // LUT1_OUT -> PA7
+  /* UPDI mode : TDAT is detached from the host */
+  if (PORTMUX_CTRLA == PORTMUX_CTRLA_ALT) {
+    EVSYS_ASYNCUSER9 = EVSYS_ASYNCUSER9_OFF_gc;
+    CCL_CTRLA = 0;                      // CCL disable
+    PORTMUX_CTRLA = PORTMUX_CTRLA_DEF;  // LUT1_OUT -> PA7
+  }
 
   /* Three GPIOs are connected to the TDAT pin. */
   /* You must ensure that all items are unused. */
@@ -273,55 +488,415 @@ void send_reset_updi (void) {
   openDrainWriteMacro(PIN_PA1, HIGH); // TDAT opendrain input
   /* These macros expand into a single IO operation instruction */
 
-  /* CCL disable */
-  CCL_CTRLA = 0;
-
   /* enter UPDI setup */
   USART0_CTRLB = UPDI_USART_ON;       // USART0 enable
   USART0_BAUD = ((F_CPU / UPDI_BREAK * 8 + 1) / 2); // slow rate
-  updi_send(0x00);      // UPDI_BREAK
-  loop_until_bit_is_set(USART0_STATUS, USART_TXCIF_bp); // send wait
+  reset_state = RESET_BREAK;
+  reset_left = 0;
+  reset_ctrla = UPDI_USART_CTRLA;
+  USART0_CTRLA = UPDI_USART_CTRLA | USART_TXCIE_bm;
+  USART0_STATUS  = USART_TXCIF_bm;
+  USART0_TXDATAL = 0x00;              // UPDI_BREAK
+}
+
+void reset_finish (void) {
+  /* USART disable */
+  USART0_CTRLB = 0;
+  USART0_CTRLA = UPDI_USART_CTRLA;
+#ifdef ENABLE_TRAFFIC_REPORT
+  if (reset_state == RESET_REPORT) {
+    USART0_BAUD  = ((F_CPU / UPDI_BAUD * 8 + 1) / 2);
+    USART0_CTRLC = ( USART_CHSIZE_8BIT_gc \
+                   | USART_PMODE_EVEN_gc \
+                   | USART_CMODE_ASYNCHRONOUS_gc \
+                   | USART_SBMODE_2BIT_gc );
+    PORTMUX_CTRLB = PORTMUX_USART0_ALTERNATE_gc;  // USART0_TxD -> PA1
+  }
+  else
+#endif
+  {
+    CCL_CTRLA = CCL_ENABLE_bm | CCL_RUNSTDBY_bm;  // CCL restart
+    openDrainWriteMacro(PIN_PA5, HIGH); // TRST assert (pull-up)
+
+    /* SW1 resets itself after the operation */
+    if (reset_by_sw1) _PROTECTED_WRITE(RSTCTRL_SWRR, RSTCTRL_SWRE_bm);
+  }
+  reset_state = RESET_IDLE;
+
+  /* Restore operating mode, this follows any DTR edge meanwhile */
+  switch_pass_through_mode();
+  if (reset_sw1_again) {
+    /* A fresh SW1 sequence with its hold, it also covers a queued RTS */
+    reset_sw1_again = false;
+    reset_again = false;
+    reset_by_sw1 = true;
+    reset_start();
+  }
+  else if (reset_again) {
+    reset_again = false;
+    reset_start();
+  }
+}
+
+/* Called when a transmission ends and on each tick while waiting */
+void reset_step (void) {
+  TCB0_INTCTRL = 0;
+  if (reset_state == RESET_SETUP) {
+    /* target setup wait */
+    if (!digitalReadMacro(PIN_PC2)) TCB0_INTCTRL = TCB_CAPT_bm;
+    /* UPDI reset command */
+    else updi_send(updi_assert, sizeof(updi_assert), RESET_ASSERT);
+  }
+  else if (reset_state == RESET_HOLD) {
+    /* While SW1 is pressed, blink the LED and wait */
+    if (reset_by_sw1 && !digitalReadMacro(PIN_PA4)) {
+      if ((++reset_blink & 3) == 0) pinControlRegister(PIN_PA3) ^= PORT_INVEN_bm;
+      TCB0_INTCTRL = TCB_CAPT_bm;
+    }
+    /* UPDI not-reset and exit command */
+    else {
+      pinControlRegister(PIN_PA3) = LED_ON;
+      updi_send(updi_release, sizeof(updi_release), RESET_RELEASE);
+    }
+  }
+}
+
+ISR(USART0_DRE_vect) {
+  USART0_STATUS  = USART_TXCIF_bm;
+  USART0_TXDATAL = *reset_ptr++;
+  if (!--reset_left) USART0_CTRLA = reset_ctrla | USART_TXCIE_bm;
+}
+
+ISR(USART0_TXC_vect) {
+  USART0_STATUS = USART_TXCIF_bm;
+  /* Only the end of the last byte counts */
+  if (reset_left) return;
+  switch (reset_state) {
+    case RESET_BREAK : {
+      USART0_BAUD = ((F_CPU / UPDI_BAUD * 8 + 1) / 2);  // normal rate
+      reset_state = RESET_SETUP;
+      reset_step();
+      break;
+    }
+    case RESET_ASSERT : {
+      reset_state = RESET_HOLD;
+      reset_step();
+      break;
+    }
+    case RESET_RELEASE :
+    case RESET_REPORT : {
+      reset_finish();
+      break;
+    }
+  }
+}
+
+ISR(TCB0_INT_vect) {
+  TCB0_INTFLAGS = TCB_CAPT_bm;
+  reset_step();
+}
+
+#ifdef ENABLE_TRAFFIC_REPORT
+/**********
+ * Traffic report
+ *
+ * A BREAK from the host (TxD low for a whole window) makes SUM send
+ * one line to the host RxD at REPORT_BAUD 8N1, in place of the target.
+ *
+ *   SUM t=<seconds> tx=<edges> rx=<edges> txb=<bytes> rxb=<bytes>
+ *       rst=<resets> drop=<RTS dropped> brk=<BREAKs>
+ *
+ * The edges are rising edges, doubled for the half time counted.
+ * The bytes assume random 8N1 data (2.75 rising edges per byte).
+ */
+char *put_number (char *p, const char *_name, uint32_t _value) {
+  char _digits[10];
+  uint8_t i = 0;
+  while (*_name) *p++ = *_name++;
+  do {
+    _digits[i++] = '0' + _value % 10;
+    _value /= 10;
+  } while (_value);
+  while (i) *p++ = _digits[--i];
+  return p;
+}
+
+void report_start (void) {
+  char *p = traffic_line;
+  p = put_number(p, "SUM t=", traffic_windows >> 3);
+  p = put_number(p, " tx=", traffic_tx << 1);
+  p = put_number(p, " rx=", traffic_rx << 1);
+  p = put_number(p, " txb=", (traffic_tx / 11) << 3);
+  p = put_number(p, " rxb=", (traffic_rx / 11) << 3);
+  p = put_number(p, " rst=", traffic_resets);
+  p = put_number(p, " drop=", traffic_dropped);
+  p = put_number(p, " brk=", traffic_breaks);
+  *p++ = '\r';
+  *p++ = '\n';
+
+  /* EVOUT1 gives PB2:RxD to USART0_TxD for the line */
+  PORTMUX_CTRLA &= ~PORTMUX_EVOUT1_bm;
+  PORTMUX_CTRLB = 0;                  // USART0_TxD -> PB2
+  USART0_BAUD  = ((F_CPU / REPORT_BAUD * 8 + 1) / 2);
+  USART0_CTRLC = ( USART_CHSIZE_8BIT_gc \
+                 | USART_PMODE_DISABLED_gc \
+                 | USART_CMODE_ASYNCHRONOUS_gc \
+                 | USART_SBMODE_1BIT_gc );
+  USART0_CTRLB = USART_TXEN_bm;
+  reset_ctrla = 0;
+  updi_send((const uint8_t*)traffic_line, p - traffic_line, RESET_REPORT);
+}
+
+/* RTC_PIT : closes one traffic window and opens the other direction */
+ISR(RTC_PIT_vect) {
+  RTC_PITINTFLAGS = RTC_PI_bm;
+  uint32_t _edges = TCA0_SINGLE_CNT;
+  TCA0_SINGLE_CNT = 0;
+  if (TCA0_SINGLE_INTFLAGS & TCA_SINGLE_OVF_bm) {
+    TCA0_SINGLE_INTFLAGS = TCA_SINGLE_OVF_bm;
+    _edges += 0x10000;
+  }
+  bool _low = !digitalReadMacro(PIN_PC3);
+  traffic_windows++;
+  if (EVSYS_SYNCUSER0 == EVSYS_SYNCUSER0_SYNCCH0_gc) {
+    traffic_tx += _edges;
+    EVSYS_SYNCUSER0 = EVSYS_SYNCUSER0_SYNCCH1_gc;
+    /* No rising edge and low at both ends : the host sends a BREAK */
+    if (_edges == 0 && _low && traffic_low) {
+      traffic_breaks++;
+#ifdef ENABLE_UPDI_ACCEL
+      if (accel_mode) return;
+#endif
+      if (reset_state == RESET_IDLE) report_start();
+    }
+  }
+  else {
+    traffic_rx += _edges;
+    EVSYS_SYNCUSER0 = EVSYS_SYNCUSER0_SYNCCH0_gc;
+    traffic_low = _low;
+  }
+}
+#endif
+
+#ifdef ENABLE_UPDI_ACCEL
+/**********
+ * UPDI accelerator : command set
+ *
+ * Each request is answered with a status byte and the data read.
+ *
+ *   $01 BREAK                                  -> status
+ *   $02 LDCS  reg                              -> status, value
+ *   $03 STCS  reg, value                       -> status
+ *   $04 KEY   key[8] (in UPDI wire order)      -> status
+ *   $05 READ  addr[3], count-1                 -> status, data[count]
+ *   $06 WRITE addr[3], count-1, data[count]    -> status
+ *
+ * WRITE sends the data with RSD set and clears it again after the block.
+ * The rest of UPDI CTRLA is what the last STCS to CTRLA wrote.
+ * The address is sent with 16 bits whenever it fits.
+ */
+enum accel_command_e {
+    ACCEL_BREAK   = 0x01
+  , ACCEL_LDCS    = 0x02
+  , ACCEL_STCS    = 0x03
+  , ACCEL_KEY     = 0x04
+  , ACCEL_READ    = 0x05
+  , ACCEL_WRITE   = 0x06
+};
+enum accel_status_e {
+    ACCEL_OK        = 0x00
+  , ACCEL_TIMEOUT   = 0x01  /* the target did not answer */
+  , ACCEL_COLLISION = 0x02  /* echo mismatch, parity or framing error */
+  , ACCEL_NOACK     = 0x03  /* no ACK to the pointer */
+  , ACCEL_ILLEGAL   = 0x7F  /* unknown command */
+};
+
+uint8_t accel_status;
+uint8_t accel_ctrla;              /* UPDI CTRLA without RSD */
+uint8_t accel_request[5 + 256];
+uint8_t accel_answer[1 + 256];
+
+/* -1 is a timeout, -2 a parity or framing error */
+int16_t accel_recv (void) {
+  uint16_t _limit = 0;
+  while (bit_is_clear(USART0_STATUS, USART_RXCIF_bp)) {
+    if (!--_limit) return -1;
+  }
+  uint8_t _flags = USART0_RXDATAH;
+  uint8_t _data = USART0_RXDATAL;
+  if (_flags & (USART_FERR_bm | USART_PERR_bm)) return -2;
+  return _data;
+}
+
+/* The first error of a request is kept */
+uint8_t accel_fail (uint8_t _status) {
+  if (accel_status == ACCEL_OK) accel_status = _status;
+  return 0;
+}
+
+uint8_t accel_read (void) {
+  int16_t _data = accel_recv();
+  if (_data < 0) return accel_fail(_data == -1 ? ACCEL_TIMEOUT : ACCEL_COLLISION);
+  return _data;
+}
+
+/* Every byte comes back through the loopback */
+void accel_send (uint8_t _data) {
+  loop_until_bit_is_set(USART0_STATUS, USART_DREIF_bp);
+  USART0_TXDATAL = _data;
+  if (accel_recv() != _data) accel_fail(ACCEL_COLLISION);
+}
+
+void accel_frame (uint8_t _op, uint8_t _arg) {
+  accel_send(0x55);             // UPDI_SYNCH
+  accel_send(_op);
+  accel_send(_arg);
+}
+
+void accel_break (void) {
+  USART0_BAUD = ((F_CPU / UPDI_BREAK * 8 + 1) / 2); // slow rate
+  USART0_TXDATAL = 0x00;        // UPDI_BREAK
+  (void)accel_recv();           // the echo is a framing error
   USART0_BAUD = ((F_CPU / UPDI_BAUD * 8 + 1) / 2);  // normal rate
-  while (!digitalReadMacro(PIN_PC2)); // target setup wait
+  uint16_t _limit = 0;
+  while (!digitalReadMacro(PIN_PC2)) {  // target setup wait
+    if (!--_limit) { accel_fail(ACCEL_TIMEOUT); break; }
+  }
+}
 
-  /* UPDI reset command */
-  updi_send(0x55);      // UPDI_SYNCH
-  updi_send(0xC8);      // UPDI_STCS | UPDI_CS_ASI_RESET_REQ
-  updi_send(0x59);      // UPDI_RSTREQ
+bool accel_pointer (const uint8_t *_addr) {
+  bool _wide = _addr[2] != 0;
+  accel_send(0x55);             // UPDI_SYNCH
+  accel_send(_wide ? 0x6A : 0x69);  // UPDI_ST | UPDI_PTR_REG | UPDI_DATA3 or 2
+  accel_send(_addr[0]);
+  accel_send(_addr[1]);
+  if (_wide) accel_send(_addr[2]);
+  if (accel_read() != 0x40) accel_fail(ACCEL_NOACK); // UPDI_ACK
+  return accel_status == ACCEL_OK;
+}
 
-  /* While SW1 is pressed, blink the LED and wait */
-  uint16_t cnt = 0;
-  while (!digitalRead(PIN_PA4)) {
-    if (cnt++ == 0) pinControlRegister(PIN_PA3) ^= PORT_INVEN_bm;
+/* Returns the length of the answer */
+uint16_t accel_execute (void) {
+  uint8_t *p = accel_request;
+  uint8_t *q = &accel_answer[1];
+  uint16_t _count = p[4] + 1;
+  switch (p[0]) {
+    case ACCEL_BREAK : {
+      accel_break();
+      return 1;
+    }
+    case ACCEL_LDCS : {
+      accel_send(0x55);         // UPDI_SYNCH
+      accel_send(0x80 | (p[1] & 15));   // UPDI_LDCS
+      *q = accel_read();
+      return 2;
+    }
+    case ACCEL_STCS : {
+      accel_frame(0xC0 | (p[1] & 15), p[2]);  // UPDI_STCS
+      if ((p[1] & 15) == 2) accel_ctrla = p[2] & ~0x08;  // UPDI_CS_CTRLA
+      return 1;
+    }
+    case ACCEL_KEY : {
+      accel_send(0x55);         // UPDI_SYNCH
+      accel_send(0xE0);         // UPDI_KEY | UPDI_KEY_64
+      for (uint8_t i = 1; i <= 8; i++) accel_send(p[i]);
+      return 1;
+    }
+    case ACCEL_READ : {
+      if (!accel_pointer(&p[1])) return 1;
+      if (_count > 1) accel_frame(0xA0, _count - 1);  // UPDI_REPEAT | UPDI_DATA1
+      accel_send(0x55);         // UPDI_SYNCH
+      accel_send(0x24);         // UPDI_LD | UPDI_PTR_INC | UPDI_DATA1
+      for (uint16_t i = 0; i < _count; i++) *q++ = accel_read();
+      return 1 + _count;
+    }
+    case ACCEL_WRITE : {
+      if (!accel_pointer(&p[1])) return 1;
+      accel_frame(0xC2, accel_ctrla | 0x08);  // UPDI_STCS | UPDI_CS_CTRLA, RSD
+      if (_count > 1) accel_frame(0xA0, _count - 1);  // UPDI_REPEAT | UPDI_DATA1
+      accel_send(0x55);         // UPDI_SYNCH
+      accel_send(0x64);         // UPDI_ST | UPDI_PTR_INC | UPDI_DATA1
+      for (uint16_t i = 0; i < _count; i++) accel_send(p[5 + i]);
+      accel_frame(0xC2, accel_ctrla);
+      return 1;
+    }
   }
-  pinControlRegister(PIN_PA3) = LED_ON;
+  accel_fail(ACCEL_ILLEGAL);
+  return 1;
+}
 
-  /* UPDI not-reset command */
-  updi_send(0x55);      // UPDI_SYNCH
-  updi_send(0xC8);      // UPDI_STCS | UPDI_CS_ASI_RESET_REQ
-  updi_send(0x00);      // UPDI_NOP
+/* Length of the request after the command byte, 0 is unknown */
+uint16_t accel_length (void) {
+  switch (accel_request[0]) {
+    case ACCEL_BREAK : return 1;
+    case ACCEL_LDCS  : return 2;
+    case ACCEL_STCS  : return 3;
+    case ACCEL_KEY   : return 9;
+    case ACCEL_READ  : return 5;
+    case ACCEL_WRITE : return 5 + accel_request[4] + 1;
+  }
+  return 1;
+}
 
-  /* UPDI exit command */
-  updi_send(0x55);      // UPDI_SYNCH
-  updi_send(0xC3);      // UPDI_STCS | UPDI_CS_CTRLB
-  updi_send(0x04);      // UPDI_SET_UPDIDIS
+/* Called from the main loop while the accelerator owns USART0 */
+void accel_poll (void) {
+  cli();
+  if (!accel_mode || reset_state != RESET_IDLE
+   || bit_is_clear(USART0_STATUS, USART_RXCIF_bp)) {
+    sei();
+    return;
+  }
+  accel_busy = true;
+  sei();
 
-  /* USART disable */
-  loop_until_bit_is_set(USART0_STATUS, USART_TXCIF_bp); // send wait
-  USART0_CTRLB = 0;
-  CCL_CTRLA = CCL_ENABLE_bm | CCL_RUNSTDBY_bm;  // CCL restart
-  openDrainWriteMacro(PIN_PA5, HIGH); // TRST assert (pull-up)
+  /* A request broken off by the host is discarded */
+  uint16_t _length = 1;
+  bool _complete = true;
+  for (uint16_t i = 0; i < _length; i++) {
+    int16_t _data = accel_recv();
+    if (_data < 0) { _complete = false; break; }
+    accel_request[i] = _data;
+    if (i == 0 || (i == 4 && accel_request[0] == ACCEL_WRITE)) _length = accel_length();
+  }
 
-  /* Restore operating mode */
-  switch_pass_through_mode();
+  if (_complete) {
+    accel_status = ACCEL_OK;
+    accel_target();
+    uint16_t _answer = accel_execute();
+    accel_answer[0] = accel_status;
+    accel_host();
+    for (uint16_t i = 0; i < _answer; i++) {
+      loop_until_bit_is_set(USART0_STATUS, USART_DREIF_bp);
+      USART0_TXDATAL = accel_answer[i];
+    }
+    loop_until_bit_is_set(USART0_STATUS, USART_DREIF_bp);
+  }
+
+  /* Events held off during the request */
+  cli();
+  accel_busy = false;
+  if (accel_mode == is_pass_through_mode_of_uart()) switch_pass_through_mode();
+  if (reset_again) {
+    reset_again = false;
+    reset_start();
+  }
+  sei();
 }
+#endif
 
 /* PORTA_INT : sense SW1 / LEVEL */
 /* SW1 controls the reset of the target MCU. */
 /* It will reset itself after the operation. */
-ISR(portIntrruptVector(PIN_PA4), ISR_NAKED) {
-  send_reset_updi();
-  _PROTECTED_WRITE(RSTCTRL_SWRR, RSTCTRL_SWRE_bm);  // system reset
+ISR(portIntrruptVector(PIN_PA4)) {
+  pinControlRegister(PIN_PA4) = PORT_ISC_INTDISABLE_gc | PORT_PULLUPEN_bm;
+  PORTA_INTFLAGS = PIN4_bm;
+  /* A running sequence ends as it began, then SW1 runs its own */
+  if (reset_state != RESET_IDLE) {
+    reset_sw1_again = true;
+    return;
+  }
+  reset_by_sw1 = true;
+  reset_start();
 }
 
 /* The order in which the following events occur together is unknown. */
@@ -332,8 +907,11 @@ ISR(portIntrruptVector(PIN_PB0)) {
   PORTB_INTFLAGS = PIN0_bm;
   // /* Reboot if external reset is requested */
   // if (!digitalRead(PIN_PB4)) _PROTECTED_WRITE(RSTCTRL_SWRR, RSTCTRL_SWRE_bm);
-  /* Otherwise switch the operating mode */
-  switch_pass_through_mode();
+  /* Otherwise switch the operating mode, after a running reset */
+#ifdef ENABLE_UPDI_ACCEL
+  if (accel_busy) return;
+#endif
+  if (reset_state == RESET_IDLE) switch_pass_through_mode();
 }
 
 /* PORTC_INT : sense RTS / FALLING */
@@ -344,8 +922,7 @@ ISR(portIntrruptVector(PIN_PC0)) {
   bool sw2_3 = digitalReadMacro(PIN_PB5); // ON is false
   /* UART fixed mode only */
   if (sw2_2 && sw2_3) {         // DIP 2-OFF and 3-OFF
-    send_reset_updi();          // This process takes time.
-    PORTB_INTFLAGS = PIN0_bm;   // Therefore, DTR events are ignored.
+    reset_start();              // This runs on interrupts.
   }
   /* In other than UPDI fixed mode, operate the TRST line. */
   else if (!sw2_2 || sw2_3) {   // DIP 2-ON or 3-OFF 
@@ -361,7 +938,26 @@ int main (void) {
   setup_peripheral();
   switch_pass_through_mode();
   sei();
-  for (;;) power_standby();
+  for (;;) {
+#ifdef ENABLE_UPDI_ACCEL
+    /* The accelerator polls the host instead of sleeping */
+    if (accel_mode) {
+      accel_poll();
+      continue;
+    }
+#endif
+    /* USART0 stops in standby, so a running reset only idles */
+    cli();
+#ifdef ENABLE_TRAFFIC_REPORT
+    /* The synchronous events and TCA0 need CLK_PER */
+    SLPCTRL_CTRLA = SLPCTRL_SEN_bm | SLPCTRL_SMODE_IDLE_gc;
+#else
+    SLPCTRL_CTRLA = SLPCTRL_SEN_bm
+      | (reset_state == RESET_IDLE ? SLPCTRL_SMODE_STDBY_gc : SLPCTRL_SMODE_IDLE_gc);
+#endif
+    sei();
+    sleep_cpu();
+  }
   /* There is nothing for the MCU to do while waiting for operation */
 }
 
@@ -0,0 +1,161 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+"""
+UPDI accelerator client of SUM_FW2401A (ENABLE_UPDI_ACCEL)
+
+ usage: sum_accel.py /dev/ttyUSB0 [-a 0x1100] [-n 3]
+
+ The host side runs at 500000bps 8N1. Each request is one command byte
+ and its arguments, and is answered with a status byte and the data
+ read. The next request must wait for the answer. DTR is released on
+ open, which selects UPDI mode when the DIP switch is in auto mode.
+ The script opens the UPDI with BREAK, reads STATUSA and then reads
+ -n bytes from -a (the signature row of tinyAVR and megaAVR by default,
+ use 0x1080 for AVR Dx/Ex). Nothing is written to the target.
+
+ @file sum_accel.py
+ @author askn (K.Sato) multix.jp
+ @copyright Copyright (c) 2024 askn37 at github.com
+"""
+import argparse
+import fcntl
+import os
+import select
+import struct
+import sys
+import termios
+import time
+
+# Commands (accel_command_e of main.cpp)
+ACCEL_BREAK     = 0x01
+ACCEL_LDCS      = 0x02
+ACCEL_STCS      = 0x03
+ACCEL_KEY       = 0x04
+ACCEL_READ      = 0x05
+ACCEL_WRITE     = 0x06
+
+# Status byte (accel_status_e of main.cpp)
+STATUS_TEXT = {
+    0x00: 'ok',
+    0x01: 'timeout',
+    0x02: 'collision',
+    0x03: 'no ACK',
+    0x7F: 'illegal command',
+}
+
+# UPDI control and status registers
+UPDI_CS_STATUSA = 0x00
+UPDI_CS_CTRLA   = 0x02
+UPDI_CS_CTRLB   = 0x03
+
+
+class AccelError(Exception):
+    pass
+
+
+class Accel:
+    """One SUM in UPDI accelerator mode on a serial port"""
+
+    def __init__(self, path, timeout=1.0):
+        self.timeout = timeout
+        self.fd = os.open(path, os.O_RDWR | os.O_NOCTTY)
+        attr = termios.tcgetattr(self.fd)
+        attr[0] = 0                                           # iflag
+        attr[1] = 0                                           # oflag
+        attr[2] = termios.CS8 | termios.CREAD | termios.CLOCAL
+        attr[3] = 0                                           # lflag
+        attr[4] = attr[5] = termios.B500000
+        attr[6][termios.VMIN] = 0
+        attr[6][termios.VTIME] = 0
+        termios.tcsetattr(self.fd, termios.TCSANOW, attr)
+        # DTR released is UPDI mode, then the mode switch settles
+        try:
+            fcntl.ioctl(self.fd, termios.TIOCMBIC, struct.pack('I', termios.TIOCM_DTR))
+        except OSError:
+            pass                                              # no modem lines (pty)
+        time.sleep(0.05)
+        termios.tcflush(self.fd, termios.TCIOFLUSH)
+
+    def close(self):
+        if self.fd is not None:
+            os.close(self.fd)
+            self.fd = None
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *args):
+        self.close()
+
+    def _recv(self, length):
+        data = b''
+        limit = time.monotonic() + self.timeout
+        while len(data) < length:
+            left = limit - time.monotonic()
+            if left <= 0 or not select.select([self.fd], [], [], left)[0]:
+                raise AccelError('no answer (%d of %d bytes)' % (len(data), length))
+            data += os.read(self.fd, length - len(data))
+        return data
+
+    def request(self, body, answer=0):
+        """Sends one request, returns the data read after a good status"""
+        os.write(self.fd, bytes(body))
+        status = self._recv(1)[0]
+        if status:
+            # The rest of the answer may or may not follow
+            time.sleep(0.01)
+            termios.tcflush(self.fd, termios.TCIFLUSH)
+            raise AccelError(STATUS_TEXT.get(status, '$%02X' % status))
+        return self._recv(answer)
+
+    # --- command set ---
+
+    def updi_break(self):
+        self.request([ACCEL_BREAK])
+
+    def ldcs(self, reg):
+        return self.request([ACCEL_LDCS, reg], 1)[0]
+
+    def stcs(self, reg, value):
+        self.request([ACCEL_STCS, reg, value])
+
+    def key(self, name):
+        """name is the 8 character key, sent in UPDI wire order"""
+        self.request([ACCEL_KEY] + list(reversed(name.encode())))
+
+    def read(self, addr, count):
+        """1 to 256 bytes from addr"""
+        return self.request([ACCEL_READ] + list(addr.to_bytes(3, 'little')) + [count - 1], count)
+
+    def write(self, addr, data):
+        """1 to 256 bytes to addr, sent with RSD"""
+        self.request([ACCEL_WRITE] + list(addr.to_bytes(3, 'little')) + [len(data) - 1] + list(data))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[1].strip())
+    parser.add_argument('port')
+    parser.add_argument('-a', '--addr', type=lambda v: int(v, 0), default=0x1100,
+                        help='address to read')
+    parser.add_argument('-n', '--count', type=int, default=3, help='bytes to read (1 to 256)')
+    args = parser.parse_args()
+
+    if not 1 <= args.count <= 256:
+        parser.error('the count is 1 to 256')
+    try:
+        with Accel(args.port) as accel:
+            accel.updi_break()
+            # Collision detection off, as SerialUPDI clients do
+            accel.stcs(UPDI_CS_CTRLB, 0x08)
+            print('UPDI revision %d' % (accel.ldcs(UPDI_CS_STATUSA) >> 4))
+            data = accel.read(args.addr, args.count)
+    except (AccelError, OSError) as e:
+        print('failed : %s' % e)
+        return 1
+    for i in range(0, len(data), 16):
+        print('%06X : %s' % (args.addr + i, ' '.join('%02X' % b for b in data[i:i + 16])))
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -17,6 +17,9 @@
 /* Locked devices return a tentative signature */
 #define ENABLE_ADDFEATS_LOCK_SIG
 
+/* Skip EEPROM bytes that already hold the data to be written */
+#define ENABLE_ADDFEATS_EEPROM_DIFF
+
 /* Enable SIB to be output as IO dump */
 // #define ENABLE_ADDFEATS_DUMP_SIB
 
@@ -30,6 +33,47 @@
 /* EXPERIMENTAL : Use UPDI double speed mode if possible */
 // #define ENABLE_UPDI_DOUBLESPEED
 
+/* EXPERIMENTAL : Run at F_CPU * 2 when the measured VDD allows it */
+/* Requires the 20MHz oscillator fuse with F_CPU at 10MHz           */
+// #define ENABLE_CLOCK_SCALING
+
+/* Enable target memory watch streaming in terminal mode */
+// #define ENABLE_ADDFEATS_WATCH
+
+/* Enable target-to-host log mailbox drained over UPDI */
+// #define ENABLE_ADDFEATS_MAILBOX
+
+/* Enable waiting for a target memory value after programming */
+// #define ENABLE_ADDFEATS_WAIT
+
+/* Enable per-board serialization with the template kept in own EEPROM */
+// #define ENABLE_ADDFEATS_SERIAL
+
+/* Enable filling target memory with a pattern generated locally */
+// #define ENABLE_ADDFEATS_FILL
+
+/* Enable continuous bulk streaming of target memory without packet turnaround */
+// #define ENABLE_ADDFEATS_STREAM
+
+/* Enable the host link loopback and error counters for baud rate qualification */
+// #define ENABLE_ADDFEATS_LOOPBACK
+
+/* Enable the UPDI link characterization sweep on target SRAM */
+// #define ENABLE_ADDFEATS_SWEEP
+
+/* Answer a flash page write before the target finishes programming it */
+// #define ENABLE_ADDFEATS_WRITE_BEHIND
+
+/* Read the next flash block ahead while answering a sequential read */
+/* Requires SRAM 3KB or more (ATtiny3226/3227)                        */
+// #define ENABLE_ADDFEATS_PREFETCH
+
+/* Read each flash page back after writing and answer a mismatch */
+// #define ENABLE_ADDFEATS_WRITE_VERIFY
+
+/* Erase the application, boot, EEPROM or a single page instead of the chip */
+// #define ENABLE_ADDFEATS_REGION_ERASE
+
 /********************
  * Speed definition *
  ********************/
@@ -50,6 +94,30 @@
 #define UPDI_GTVAL     UPDI::UPDI_SET_GTVAL_16
 #define UPDI_GTVAL_RSD UPDI::UPDI_SET_GTVAL_16|UPDI::UPDI_SET_RSD
 
+/* UPDI operation deadlines (ms, 4ms resolution) */
+#define TIMEOUT_REGISTER_MS (16)    /* Register and SRAM access */
+#define TIMEOUT_EEPROM_MS   (48)    /* One EEPROM write request */
+#define TIMEOUT_PAGE_MS     (48)    /* One flash page write     */
+#define TIMEOUT_ERASE_MS    (800)   /* Chip erase and mode changes */
+#define TIMEOUT_ACTIVATE_MS (125)   /* Each UPDI activation attempt */
+
+/* Longest wait for MESSAGE_START after an RTS edge (1/1024 sec ticks) */
+/* About 8 characters at 19200bps, raise it for a slow opening host     */
+#define RTS_HANDOVER_TICKS (4)
+
+/* Target memory watch : number of regions and total shadow bytes */
+#define WATCH_REGIONS (8)
+#define WATCH_SHADOW  (64)
+
+/* Serialization record size in bytes */
+#define SERIAL_RECORD (32)
+
+/* Stream chunk size limit (bytes between two CRCs, up to 128) */
+#define STREAM_CHUNK  (128)
+
+/* Lowest VDD for F_CPU * 2 (mV) */
+#define CLOCK_SCALING_MV (4500)
+
 /* LED Timer config */
 #define HBEAT_HZ   (0.5)
 #define TCA0_STEP  ((uint8_t)(sqrt((F_CPU / 1024.0) * (1.0 / HBEAT_HZ)) - 0.5))
@@ -59,6 +127,12 @@
 #define TCB1_FLASH ((8 * 256) + TCB1_STEP - 1)
 #define TCB1_FAST  ((4 * 256) + TCB1_STEP / 8)
 
+/* Heartbeat at F_CPU * 2 : the same period with a longer step */
+#define TCA0_STEP_SCALED  ((uint8_t)(sqrt((F_CPU * 2 / 1024.0) * (1.0 / HBEAT_HZ)) - 0.5))
+#define TCB1_HBEAT_SCALED (((TCA0_STEP_SCALED / 2) * 256) + TCA0_STEP_SCALED - 1)
+#define HBEAT_STEP (SYS::clock_shift ? TCA0_STEP_SCALED : TCA0_STEP)
+#define HBEAT_CCMP (SYS::clock_shift ? TCB1_HBEAT_SCALED : TCB1_HBEAT)
+
 /*******************
  * GPIO allocation *
  *******************/
@@ -98,6 +172,8 @@
 #define JTAG_RXD_CONFIG   ( PORT_PULLUPEN_bm | PORT_ISC_INTDISABLE_gc )
 #define JTAG_PMUX_ALT     PORTMUX_USART1_ALT1_gc
 #define JTAG_USART        USART1
+#define JTAG_USART_RXC    USART1_RXC_vect
+#define JTAG_USART_DRE    USART1_DRE_vect
 #define JTAG_USART_CTRLA  ( 0 )
 #define JTAG_USART_ON     ( USART_RXEN_bm | USART_ODME_bm | USART_TXEN_bm)
 #define JTAG_USART_DBLON  ( USART_RXEN_bm | USART_ODME_bm | USART_TXEN_bm | USART_RXMODE_CLK2X_gc )
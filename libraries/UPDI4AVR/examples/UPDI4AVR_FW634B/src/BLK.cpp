@@ -0,0 +1,233 @@
+/**
+ * @file BLK.cpp
+ * @author askn (K.Sato) multix.jp
+ * @brief
+ * @version 0.1
+ * @date 2023-12-24
+ *
+ * @copyright Copyright (c) 2023 askn37 at github.com
+ *
+ */
+#include "Prototypes.h"
+#include <api/capsule.h>
+
+#ifdef ENABLE_ADDFEATS_STREAM
+
+/* Two chunk slots are placed between the write request area and the EEPROM work area */
+#if (STREAM_CHUNK > 128) || (10 + STREAM_CHUNK + (STREAM_CHUNK + 3) * 2 > 10 + 512 + 10 - 64)
+  #warning STREAM_CHUNK is too large
+  #include BUILD_STOP
+#endif
+
+/* Longest silence of the host inside a stream (1/1024 sec) */
+#define STREAM_IDLE   (1024)
+/* Silence that ends the discarding of an aborted stream (1/1024 sec) */
+#define STREAM_DRAIN  (16)
+
+namespace BLK {
+  uint8_t mem_type;
+  uint8_t chunk;
+  bool reading;
+  uint16_t unit;
+  uint32_t addr;
+  uint32_t total;
+
+  /* Shared with the USART interrupts */
+  uint8_t *volatile isr_ptr;
+  volatile uint8_t isr_left;
+  volatile uint8_t isr_slot;
+  volatile uint8_t isr_ready;
+  uint32_t isr_total;
+
+  inline uint8_t *slot_ptr (uint8_t _slot) {
+    return &JTAG2::packet.body[JTAG2::DATA_START + STREAM_CHUNK + _slot * (STREAM_CHUNK + 3)];
+  }
+
+  inline uint8_t chunk_length (uint32_t _remain) {
+    return _remain < chunk ? (uint8_t)_remain : chunk;
+  }
+
+  /*****************
+   * Write streams *
+   *****************/
+
+  /* Each chunk is split into write requests the same way as CMND_FILL_MEMORY */
+  /* The chunk is already staged at DATA_START, each piece is moved down to it */
+  uint8_t write_chunk (uint8_t _len) {
+    uint8_t i = 0;
+    do {
+      uint16_t _piece = JTAG2::piece_length(unit, addr, _len - i);
+      if (!JTAG2::write_piece(mem_type, addr, _piece))
+        return JTAG2::packet.body[JTAG2::MESSAGE_ID];
+      addr += _piece;
+      i += _piece;
+      uint8_t *q = &JTAG2::packet.body[JTAG2::DATA_START];
+      for (uint8_t j = 0; j < (uint8_t)(_len - i); j++) q[j] = q[j + _piece];
+    } while (i < _len);
+    return JTAG2::RSP_OK;
+  }
+
+  uint8_t write_stream (uint32_t &_done) {
+    uint8_t _slot = 0;
+    uint32_t _remain = total;
+    uint16_t _stamp = TIM::Ticks();
+
+    /* The interrupt fills the slots in turn until the whole length is assigned */
+    uint8_t _len = chunk_length(total);
+    isr_total = total - _len;
+    isr_left = _len + 2;
+    isr_slot = 0;
+    isr_ptr = slot_ptr(0);
+    isr_ready = 0;
+    JTAG_USART.CTRLA = JTAG_USART_CTRLA | USART_RXCIE_bm;
+
+    do {
+      _len = chunk_length(_remain);
+      /* The host never has more than two chunks outstanding */
+      while (!isr_ready) {
+        wdt_reset();
+        if ((uint16_t)(TIM::Ticks() - _stamp) > STREAM_IDLE) return JTAG2::RSP_FAILED;
+      }
+      uint8_t *p = slot_ptr(_slot);
+      uint16_t _crc = ~0;
+      for (uint8_t i = 0; i < (uint8_t)(_len + 2); i++) _crc = JTAG2::crc16_update(_crc, p[i]);
+      if (_crc) return JTAG2::RSP_FAILED;
+      /* Staged out of the slot before the write, so the slot is free again : */
+      /* the host may send one more chunk while this one is being written.    */
+      uint8_t *q = &JTAG2::packet.body[JTAG2::DATA_START];
+      for (uint8_t i = 0; i < _len; i++) q[i] = p[i];
+      ATOMIC_BLOCK(ATOMIC_RESTORESTATE) { isr_ready--; }
+      _slot ^= 1;
+      JTAG2::put(JTAG2::STREAM_MARK);
+      uint8_t _response = write_chunk(_len);
+      if (_response != JTAG2::RSP_OK) return _response;
+      _remain -= _len;
+      _done += _len;
+      _stamp = TIM::Ticks();
+    } while (_remain);
+    return JTAG2::RSP_OK;
+  }
+
+  /****************
+   * Read streams *
+   ****************/
+
+  uint8_t read_stream (uint32_t &_done) {
+    uint8_t _slot = 0;
+    uint32_t _remain = total;
+    isr_left = 0;
+    do {
+      uint8_t _len = chunk_length(_remain);
+      JTAG2::packet.body[JTAG2::MEM_TYPE] = mem_type;
+      _CAPS32(JTAG2::packet.body[JTAG2::DATA_LENGTH])->dword = _len;
+      _CAPS32(JTAG2::packet.body[JTAG2::DATA_ADDRESS])->dword = addr;
+      if (!UPDI::runtime(UPDI::UPDI_CMD_READ_MEMORY)) return JTAG2::RSP_ILLEGAL_MCU_STATE;
+      if (JTAG2::packet.body[JTAG2::MESSAGE_ID] != JTAG2::RSP_MEMORY)
+        return JTAG2::packet.body[JTAG2::MESSAGE_ID];
+      /* The other slot may still be on the wire */
+      uint8_t *p = slot_ptr(_slot);
+      uint8_t *q = &JTAG2::packet.body[JTAG2::RSP_DATA];
+      uint16_t _crc = ~0;
+      *p++ = JTAG2::STREAM_MARK;
+      for (uint8_t i = 0; i < _len; i++) _crc = JTAG2::crc16_update(_crc, *p++ = *q++);
+      *p++ = _CAPS16(_crc)->bytes[0];
+      *p = _CAPS16(_crc)->bytes[1];
+      while (isr_left) wdt_reset();
+      isr_ptr = slot_ptr(_slot);
+      isr_left = _len + 3;
+      JTAG_USART.CTRLA = JTAG_USART_CTRLA | USART_DREIE_bm;
+      _slot ^= 1;
+      addr += _len;
+      _remain -= _len;
+      _done += _len;
+    } while (_remain);
+    while (isr_left) wdt_reset();
+    return JTAG2::RSP_OK;
+  }
+}
+
+/******************************
+ * Streaming interrupt driven *
+ ******************************/
+
+ISR(JTAG_USART_RXC) {
+  *BLK::isr_ptr++ = JTAG_USART.RXDATAL;
+  if (--BLK::isr_left) return;
+  BLK::isr_ready++;
+  BLK::isr_slot ^= 1;
+  BLK::isr_ptr = BLK::slot_ptr(BLK::isr_slot);
+  if (BLK::isr_total) {
+    uint8_t _len = BLK::chunk_length(BLK::isr_total);
+    BLK::isr_total -= _len;
+    BLK::isr_left = _len + 2;
+  }
+  else JTAG_USART.CTRLA = JTAG_USART_CTRLA;
+}
+
+ISR(JTAG_USART_DRE) {
+  JTAG_USART.STATUS = USART_TXCIF_bm;
+  JTAG_USART.TXDATAL = *BLK::isr_ptr++;
+  if (!--BLK::isr_left) JTAG_USART.CTRLA = JTAG_USART_CTRLA;
+}
+
+/**********************
+ * CMND_STREAM_MEMORY *
+ **********************/
+
+/*
+ * Same layout as CMND_WRITE_MEMORY up to the address
+ *   body[1]     : memory type
+ *   body[2..5]  : total length
+ *   body[6..9]  : start address
+ *   body[10]    : 0 = host to target, 1 = target to host
+ *   body[11]    : chunk size between CRCs (1 to STREAM_CHUNK, a power of two to write)
+ *
+ * After RSP_OK the raw stream follows, and one final answer closes it
+ *   write : { data[chunk], CRC16 } ... from the host, STREAM_MARK for each slot freed
+ *   read  : { STREAM_MARK, data[chunk], CRC16 } ... to the host
+ *   final : RSP_OK or the error, body[1..4] = bytes completed
+ */
+
+bool BLK::stream_setup (void) {
+  mem_type = JTAG2::packet.body[JTAG2::MEM_TYPE];
+  total = _CAPS32(JTAG2::packet.body[JTAG2::DATA_LENGTH])->dword;
+  addr = _CAPS32(JTAG2::packet.body[JTAG2::DATA_ADDRESS])->dword;
+  reading = JTAG2::packet.body[JTAG2::DATA_START];
+  chunk = JTAG2::packet.body[JTAG2::DATA_START + 1];
+  if (JTAG2::packet.size_word[0] != 12 || total == 0 || chunk == 0
+   || chunk > STREAM_CHUNK || JTAG2::packet.body[JTAG2::DATA_START] > 1
+   || (!reading && (chunk & (chunk - 1)))) {
+    JTAG2::set_response(JTAG2::RSP_ILLEGAL_VALUE);
+    return false;
+  }
+  if (!reading) {
+    unit = JTAG2::write_unit(mem_type, addr, total);
+    if (!unit) return false;
+  }
+  return true;
+}
+
+void BLK::stream (void) {
+  uint32_t _done = 0;
+  uint8_t _response = reading ? read_stream(_done) : write_stream(_done);
+  JTAG_USART.CTRLA = JTAG_USART_CTRLA;
+  if (_response != JTAG2::RSP_OK && !reading) {
+    /* Whatever the host already sent is discarded until the line is quiet */
+    uint16_t _stamp = TIM::Ticks();
+    while ((uint16_t)(TIM::Ticks() - _stamp) < STREAM_DRAIN) {
+      wdt_reset();
+      if (bit_is_set(JTAG_USART.STATUS, USART_RXCIF_bp)) {
+        (void)JTAG_USART.RXDATAL;
+        _stamp = TIM::Ticks();
+      }
+    }
+  }
+  JTAG2::flush();
+  JTAG2::packet.body[JTAG2::MESSAGE_ID] = _response;
+  _CAPS32(JTAG2::packet.body[1])->dword = _done;
+  JTAG2::packet.size_word[0] = 5;
+}
+
+#endif
+
+// end of code
@@ -16,12 +16,29 @@
 #define BAUD_REG_VAL(baud) (((F_CPU / (baud >> 3)) + 1) / 2)
 #define PARAM_VTARGET_VAL 5000
 
+/* The table is for F_CPU, and the usable range follows the boot clock */
+#ifdef ENABLE_CLOCK_SCALING
+#define BAUD_LOWER_RUN (SYS::clock_shift ? BAUD_LOWER_SCALED : BAUD_LOWER)
+#define BAUD_UPPER_RUN (SYS::clock_shift ? BAUD_UPPER_SCALED : BAUD_UPPER)
+#else
+#define BAUD_LOWER_RUN BAUD_LOWER
+#define BAUD_UPPER_RUN BAUD_UPPER
+#endif
+
 namespace JTAG2 {
   /* Global valiables */
   updi_device_descriptor updi_desc;
   jtag_packet_t packet;
   jtag_baud_rate_e param_baud_rate_val = BAUD_19200;
   uint16_t before_seqnum = -1;
+  #ifdef ENABLE_ADDFEATS_LOOPBACK
+  /* Host link statistics */
+  uint16_t link_packets = 0;
+  uint16_t link_crc_errors = 0;
+  uint16_t link_frame_errors = 0;
+  uint16_t link_turnaround = 0;
+  bool link_measure = false;
+  #endif
 
   const uint16_t BAUD_TABLE[] PROGMEM = {
       BAUD_NOTUSED          // 0: not used dummy
@@ -123,23 +140,51 @@ namespace JTAG2 {
     uint8_t *q = (uint8_t*) &packet.soh;
 
     /* Waiting for reception (infinite loop) */
-    while (get() != MESSAGE_START);
+    for (;;) {
+      if (bit_is_set(JTAG_USART.STATUS, USART_RXCIF_bp)) {
+        if (get() == MESSAGE_START) break;
+        /* Not a JTAG host : the UART goes back to the target at once */
+        if (SYS::Handover_Pending()) SYS::Handover();
+      }
+      else if (SYS::Handover_Expired()) SYS::Handover();
+    }
+    SYS::Handover_Cancel();
     (*p++) = MESSAGE_START;
 
     /* First 7bytes */
     for (int8_t i = 0; i < 7; i++) *p++ = get();
 
-    /* STX confirmation */
-    if (packet.stx != TOKEN) return false;
-
-    /* Check packet length */
-    if (packet.size > sizeof(packet.body)) return false;
+    /* STX confirmation and packet length */
+    if (packet.stx != TOKEN || packet.size > sizeof(packet.body)) {
+      #ifdef ENABLE_ADDFEATS_LOOPBACK
+      link_frame_errors++;
+      #endif
+      return false;
+    }
 
     /* receive the rest */
     for (int16_t j = -2; j < packet.size_word[0]; j++) *p++ = get();
 
+    #ifdef ENABLE_ADDFEATS_LOOPBACK
+    /* TCB0 is free between UPDI operations : it measures the echo turnaround */
+    bool _echo = packet.body[MESSAGE_ID] == CMND_LOOPBACK && packet.body[1] == 0;
+    if (_echo) {
+      TCB0_INTCTRL = 0;
+      TCB0_CCMP = ~0;
+      TCB0_CNT = 0;
+      TCB0_CTRLA = TCB_ENABLE_bm | TCB_CLKSEL_DIV2_gc;
+    }
+    #endif
+
     /* CRC check when receive buffer is filled */
     while (p != q) _crc = crc16_update(_crc, *q++);
+    #ifdef ENABLE_ADDFEATS_LOOPBACK
+    if (_crc) {
+      link_crc_errors++;
+      if (_echo) TCB0_CTRLA = 0;
+    }
+    else link_packets++;
+    #endif
     return _crc == 0;
   }
 
@@ -147,18 +192,51 @@ namespace JTAG2 {
    * JTAG Answer *
    ***************/
 
-  void answer_transfer (void) {
+  /* The answer not yet sent : answer_begin() to answer_rest() */
+  uint8_t *answer_p;
+  uint8_t *answer_q;
+
+  void answer_begin (void) {
     uint16_t _crc = ~0;
     int16_t _len = packet.size_word[0] + 8;
-    uint8_t *_p = (uint8_t*) &packet.soh;
     uint8_t *_q = (uint8_t*) &packet.soh;
     while (_len--) _crc = crc16_update(_crc, *_q++);
     (*_q++) = _CAPS16(_crc)->bytes[0];
     (*_q++) = _CAPS16(_crc)->bytes[1];
+    #ifdef ENABLE_ADDFEATS_LOOPBACK
+    if (link_measure) {
+      link_turnaround = TCB0_CNT;
+      TCB0_CTRLA = 0;
+      link_measure = false;
+    }
+    #endif
+    answer_p = (uint8_t*) &packet.soh;
+    answer_q = _q;
+  }
+
+  void answer_rest (void) {
+    uint8_t *_p = answer_p;
+    uint8_t *_q = answer_q;
     ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
       while (_p != _q) put(*_p++);
     }
+    answer_p = _p;
+  }
+
+  void answer_transfer (void) {
+    answer_begin();
+    answer_rest();
+  }
+
+  #ifdef ENABLE_ADDFEATS_PREFETCH
+  /* Sends one byte of the answer only if the transmitter is free */
+  void answer_step (void) {
+    if (answer_p != answer_q && bit_is_set(JTAG_USART.STATUS, USART_DREIF_bp)) {
+      JTAG_USART.STATUS = USART_TXCIF_bm;
+      JTAG_USART.TXDATAL = *answer_p++;
+    }
   }
+  #endif
 
   /********************
    * SIGN_ON Response *
@@ -191,8 +269,8 @@ namespace JTAG2 {
       /* JTAG interface speed */
       case PAR_BAUD_RATE : {
         /* Compatible range confirmation */
-        if ((param_val >= BAUD_LOWER) && (param_val <= BAUD_UPPER)) {
-          uint16_t baud = pgm_read_word( &BAUD_TABLE[param_val] );
+        if ((param_val >= BAUD_LOWER_RUN) && (param_val <= BAUD_UPPER_RUN)) {
+          uint16_t baud = pgm_read_word( &BAUD_TABLE[param_val] ) << SYS::clock_shift;
           if (baud) {
             /* If normal, respond and then change speed */
             param_baud_rate_val = (jtag_baud_rate_e) param_val;
@@ -316,12 +394,287 @@ namespace JTAG2 {
            (struct updi_device_descriptor*)&packet.body[RSP_DATA];
       if (desc->magicnumber == 'U' && desc->length <= sizeof(updi_desc) - 2) {
         uint8_t *q = 2 + (uint8_t*)&updi_desc;
-        uint8_t *p = 2 + (uint8_t*)&desc;
+        const uint8_t *p = 2 + (const uint8_t*)desc;
         for (int8_t i = 0; i < desc->length; i++) *q++ = *p++;
       }
     }
   }
 
+  #if defined(ENABLE_ADDFEATS_FILL) || defined(ENABLE_ADDFEATS_STREAM) \
+   || defined(ENABLE_ADDFEATS_SERIAL)
+  /**********************
+   * Write request size *
+   **********************/
+
+  /* The largest piece each writer accepts without falling back */
+  /* Pieces must never cross a unit boundary, and 0 is rejected */
+  uint16_t write_unit (uint8_t mem_type, uint32_t addr, uint32_t count) {
+    uint16_t _unit;
+    switch ((addr >> 24) ? MTYPE_SRAM : mem_type) {
+      case MTYPE_SRAM : {
+        _unit = 256;
+        break;
+      }
+      case MTYPE_XMEGA_EEPROM :
+      case MTYPE_EEPROM_PAGE :
+      case MTYPE_EEPROM : {
+        if (bit_is_set(UPDI_NVMCTRL, UPDI::UPDI_GEN4_bp)
+         || bit_is_set(UPDI_NVMCTRL, UPDI::UPDI_GEN2_bp)) _unit = 2;
+        else if (bit_is_set(UPDI_NVMCTRL, UPDI::UPDI_GEN3_bp)) _unit = 8;
+        else _unit = updi_desc.eeprom_page_size < 32 ? 32 : updi_desc.eeprom_page_size;
+        break;
+      }
+      case MTYPE_FLASH_PAGE :
+      case MTYPE_XMEGA_APP_FLASH :
+      case MTYPE_XMEGA_BOOT_FLASH : {
+        /* Flash is written in whole pages only */
+        _unit = updi_desc.flash_page_size;
+        if (((uint16_t)addr | (uint16_t)count) & (_unit - 1)) {
+          set_response(RSP_ILLEGAL_MEMORY_RANGE);
+          return 0;
+        }
+        break;
+      }
+      case MTYPE_XMEGA_USERSIG : {
+        /* USERROW is written in whole 32 bytes only, also when locked */
+        _unit = 32;
+        if (((uint16_t)addr | (uint16_t)count) & (_unit - 1)) {
+          set_response(RSP_ILLEGAL_MEMORY_RANGE);
+          return 0;
+        }
+        break;
+      }
+      default : {
+        set_response(RSP_ILLEGAL_MEMORY_TYPE);
+        return 0;
+      }
+    }
+    return _unit;
+  }
+
+  /* The next piece of count bytes from addr within the unit */
+  uint16_t piece_length (uint16_t unit, uint32_t addr, uint32_t count) {
+    uint16_t _len = unit - ((uint16_t)addr & (unit - 1));
+    return _len > count ? count : _len;
+  }
+
+  /* The piece staged at DATA_START as one write request with its own UPDI timeout */
+  /* False leaves the refusal as the answer, as NVM::write_memory may reject it  */
+  bool write_piece (uint8_t mem_type, uint32_t addr, uint16_t len) {
+    packet.body[MESSAGE_ID] = RSP_OK;
+    packet.body[MEM_TYPE] = mem_type;
+    _CAPS32(packet.body[DATA_LENGTH])->dword = len;
+    _CAPS32(packet.body[DATA_ADDRESS])->dword = addr;
+    if (!UPDI::runtime(UPDI::UPDI_CMD_WRITE_MEMORY)) {
+      set_response(RSP_ILLEGAL_MCU_STATE);
+      return false;
+    }
+    return packet.body[MESSAGE_ID] == RSP_OK;
+  }
+  #endif
+
+  #ifdef ENABLE_ADDFEATS_FILL
+  /********************
+   * CMND_FILL_MEMORY *
+   ********************/
+
+  /*
+   * Same layout as CMND_WRITE_MEMORY up to the address
+   *   body[1]     : memory type
+   *   body[2..5]  : fill length
+   *   body[6..9]  : start address
+   *   body[10]    : pattern length (1 to 4)
+   *   body[11..]  : pattern
+   */
+
+  void fill_memory (void) {
+    uint32_t _count = _CAPS32(packet.body[DATA_LENGTH])->dword;
+    uint32_t _addr = _CAPS32(packet.body[DATA_ADDRESS])->dword;
+    uint8_t _mem_type = packet.body[MEM_TYPE];
+    uint8_t _plen = packet.body[DATA_START];
+    uint8_t _pattern[4];
+    if (_count == 0 || _plen == 0 || _plen > 4 || packet.size_word[0] != 11 + _plen) {
+      set_response(RSP_ILLEGAL_VALUE);
+      return;
+    }
+    for (uint8_t i = 0; i < _plen; i++) _pattern[i] = packet.body[DATA_START + 1 + i];
+    uint16_t _unit = write_unit(_mem_type, _addr, _count);
+    if (!_unit) return;
+
+    uint8_t _phase = 0;
+    do {
+      uint16_t _len = piece_length(_unit, _addr, _count);
+      uint8_t *q = &packet.body[DATA_START];
+      for (uint16_t i = 0; i < _len; i++) {
+        *q++ = _pattern[_phase];
+        if (++_phase == _plen) _phase = 0;
+      }
+      if (!write_piece(_mem_type, _addr, _len)) return;
+      _addr += _len;
+      _count -= _len;
+    } while (_count);
+    packet.size_word[0] = 1;
+  }
+  #endif
+
+  #ifdef ENABLE_ADDFEATS_LOOPBACK
+  /*****************
+   * CMND_LOOPBACK *
+   *****************/
+
+  /*
+   * body[1]     : 0 = echo, 1 = statistics, 2 = clear statistics
+   *
+   * Echo answers RSP_MEMORY
+   *   body[2,3] : answer length (1 to 512, ignored for pattern 0)
+   *   body[4]   : 0 = payload as received, 1 = counting, 2 = $55/$AA, 3 = $00/$FF
+   *   body[5..] : payload
+   *
+   * Statistics answers RSP_PARAMETER
+   *   body[1,2] : good packets
+   *   body[3,4] : CRC errors
+   *   body[5,6] : framing errors (STX or length)
+   *   body[7,8] : last echo turnaround from receive to answer (usec)
+   */
+
+  void loopback (void) {
+    uint16_t _len = _CAPS16(packet.body[2])->word;
+    uint8_t _pattern = packet.body[4];
+    switch (packet.body[1]) {
+      case 0 : {
+        if (packet.size_word[0] < 5) {
+          set_response(RSP_ILLEGAL_VALUE);
+          return;
+        }
+        if (_pattern == 0) {
+          _len = packet.size_word[0] - 5;
+          for (uint16_t i = 0; i < _len; i++) packet.body[1 + i] = packet.body[5 + i];
+        }
+        else if (_len == 0 || _len > 512 || _pattern > 3) {
+          set_response(RSP_ILLEGAL_VALUE);
+          return;
+        }
+        else {
+          for (uint16_t i = 0; i < _len; i++) {
+            packet.body[1 + i] = _pattern == 1 ? (uint8_t)i
+                               : _pattern == 2 ? ((i & 1) ? 0xAA : 0x55)
+                               : ((i & 1) ? 0xFF : 0x00);
+          }
+        }
+        packet.body[MESSAGE_ID] = RSP_MEMORY;
+        packet.size_word[0] = 1 + _len;
+        link_measure = true;
+        return;
+      }
+      case 1 : {
+        packet.body[MESSAGE_ID] = RSP_PARAMETER;
+        _CAPS16(packet.body[1])->word = link_packets;
+        _CAPS16(packet.body[3])->word = link_crc_errors;
+        _CAPS16(packet.body[5])->word = link_frame_errors;
+        /* TCB0 counts CLK_PER / 2 */
+        _CAPS16(packet.body[7])->word = link_turnaround / ((F_CPU / 2000000UL) << SYS::clock_shift);
+        packet.size_word[0] = 9;
+        return;
+      }
+      case 2 : {
+        link_packets = link_crc_errors = link_frame_errors = link_turnaround = 0;
+        return;
+      }
+    }
+    set_response(RSP_ILLEGAL_PARAMETER);
+  }
+  #endif
+
+  #ifdef ENABLE_ADDFEATS_SWEEP
+  /*******************
+   * CMND_UPDI_SWEEP *
+   *******************/
+
+  /*
+   * body[1,2] : scratch address in target SRAM
+   * body[3]   : block length (1 to 255)
+   * body[4]   : rounds per cell (1 to 255)
+   * body[5]   : UPDICLKSEL to test (bit 3 = 4MHz ... bit 0 = 32MHz)
+   * body[6]   : GTVAL to test (bit 0 = 128 cycles ... bit 6 = 2 cycles)
+   *
+   * RSP_MEMORY
+   *   body[1]   : number of cells
+   *   body[2..] : { UPDICLKSEL, GTVAL, status, echo errors (2), parity errors (2),
+   *                 data errors (2), bytes per second (4) } x cells
+   *   status    : 0 = measured, 1 = link lost, 2 = out of reach at this CPU clock
+   */
+
+  void updi_sweep (void) {
+    uint8_t _clk_mask = packet.body[5];
+    uint8_t _gt_mask = packet.body[6];
+    uint8_t *q = &packet.body[2];
+    uint8_t _cells = 0;
+    if (bit_is_clear(UPDI_CONTROL, UPDI::UPDI_INFO_bp)) {
+      set_response(RSP_ILLEGAL_MCU_STATE);
+      return;
+    }
+    if (packet.size_word[0] != 7 || packet.body[3] == 0 || packet.body[4] == 0) {
+      set_response(RSP_ILLEGAL_VALUE);
+      return;
+    }
+    UPDI::sweep.addr = _CAPS16(packet.body[1])->word;
+    UPDI::sweep.length = packet.body[3];
+    UPDI::sweep.clksel_orig = 0xFF;
+    UPDI::sweep.lost = false;
+
+    /* From the slowest clock and the longest guard time */
+    for (int8_t _clk = UPDI::UPDI_SET_UPDICLKSEL_4M; _clk >= 0; _clk--) {
+      if (bit_is_clear(_clk_mask, _clk)) continue;
+      for (uint8_t _gt = 0; _gt <= UPDI::UPDI_SET_GTVAL_2; _gt++) {
+        if (bit_is_clear(_gt_mask, _gt)) continue;
+        UPDI::sweep.clksel = _clk;
+        UPDI::sweep.gtval = _gt;
+        UPDI::sweep.rounds = packet.body[4];
+        UPDI::sweep.echo_errors = 0;
+        UPDI::sweep.parity_errors = 0;
+        UPDI::sweep.data_errors = 0;
+        UPDI::sweep.ticks = 0;
+        uint8_t _status = 2;
+        uint32_t _rate = 0;
+        if (UPDI::sweep_divisor(_clk)) {
+          _status = !UPDI::runtime(UPDI::UPDI_CMD_SWEEP);
+          if (_status) UPDI::sweep.lost = true;
+          else if (UPDI::sweep.ticks) {
+            /* Both directions are counted */
+            _rate = ((uint32_t)UPDI::sweep.length * UPDI::sweep.rounds * 2 * 1024) / UPDI::sweep.ticks;
+          }
+        }
+        *q++ = _clk;
+        *q++ = _gt;
+        *q++ = _status;
+        _CAPS16(*q)->word = UPDI::sweep.echo_errors; q += 2;
+        _CAPS16(*q)->word = UPDI::sweep.parity_errors; q += 2;
+        _CAPS16(*q)->word = UPDI::sweep.data_errors; q += 2;
+        _CAPS32(*q)->dword = _rate; q += 4;
+        _cells++;
+      }
+    }
+
+    /* The normal clock and guard time are restored */
+    UPDI::sweep.rounds = 0;
+    if (!UPDI::runtime(UPDI::UPDI_CMD_SWEEP)) {
+      set_response(RSP_ILLEGAL_MCU_STATE);
+      return;
+    }
+    packet.body[MESSAGE_ID] = RSP_MEMORY;
+    packet.body[1] = _cells;
+    packet.size_word[0] = q - &packet.body[0];
+  }
+  #endif
+
+  #ifdef ENABLE_ADDFEATS_WRITE_BEHIND
+  /* Finish the page left programming, false if any page has failed */
+  bool write_settled (void) {
+    if (!NVM::write_pending) return !NVM::write_error;
+    return UPDI::runtime(UPDI::UPDI_CMD_COMPLETE);
+  }
+  #endif
+
   /****************
    * JTAG Process *
    ****************/
@@ -336,6 +689,14 @@ namespace JTAG2 {
     packet.body[MESSAGE_ID] = RSP_OK;
     switch (message_id) {
       case CMND_GET_SIGN_ON : {
+        #ifdef ENABLE_ADDFEATS_WRITE_BEHIND
+        /* A new session starts without the last failure */
+        NVM::write_pending = NVM::write_error = false;
+        #endif
+        #ifdef ENABLE_ADDFEATS_PREFETCH
+        /* The next target may not be the one read ahead */
+        NVM::prefetch_drop();
+        #endif
         SYS::WDT_ON();
         SYS::RTS_Disable();
         TIM::LED_Stop();
@@ -368,6 +729,12 @@ namespace JTAG2 {
             if (hv_control != '1') hv_active = true;
           }
           /* Here UPDI control is tried */
+          #ifdef ENABLE_ADDFEATS_WRITE_BEHIND
+          NVM::write_pending = NVM::write_error = false;
+          #endif
+          #ifdef ENABLE_ADDFEATS_PREFETCH
+          NVM::prefetch_drop();
+          #endif
           UPDI::updi_activate(hv_active);
           if (bit_is_set(UPDI_CONTROL, UPDI::UPDI_TERM_bp)) {
             /* Disable WDT when interactive mode is enabled */
@@ -386,9 +753,19 @@ namespace JTAG2 {
         break;
       }
       case CMND_READ_MEMORY : {
+        /* A page failed behind the last answer is kept for the next write */
         if (!UPDI::runtime(UPDI::UPDI_CMD_READ_MEMORY)) {
           set_response(RSP_NO_TARGET_POWER);
         }
+        #ifdef ENABLE_ADDFEATS_PREFETCH
+        else if (NVM::prefetch_ahead) {
+          /* The answer goes out while the next block is read */
+          answer_begin();
+          UPDI::runtime(UPDI::UPDI_CMD_PREFETCH);
+          answer_rest();
+          return;
+        }
+        #endif
         break;
       }
       case CMND_WRITE_MEMORY : {
@@ -396,6 +773,10 @@ namespace JTAG2 {
         if (before_seqnum == packet.number) break;
         if (UPDI::runtime(UPDI::UPDI_CMD_WRITE_MEMORY)) {
           /* Keep the sequence number if completed successfully */
+          #ifdef ENABLE_ADDFEATS_WRITE_VERIFY
+          /* A retry of a page that failed verification is written again */
+          if (packet.body[MESSAGE_ID] == RSP_OK)
+          #endif
           before_seqnum = packet.number;
         }
         else {
@@ -409,6 +790,13 @@ namespace JTAG2 {
       case CMND_XMEGA_ERASE : {
         /* Received packet error retransmission exception */
         if (before_seqnum == packet.number) break;
+        #ifdef ENABLE_ADDFEATS_WRITE_BEHIND
+        /* Only the page left programming is answered, so a chip erase can clear a failure */
+        if (NVM::write_pending && !write_settled()) {
+          set_response(RSP_FAILED);
+          break;
+        }
+        #endif
         if (UPDI::runtime(UPDI::UPDI_CMD_ERASE)) {
           /* Keep the sequence number if completed successfully */
           before_seqnum = packet.number;
@@ -421,6 +809,77 @@ namespace JTAG2 {
         #endif
         break;
       }
+      #ifdef ENABLE_ADDFEATS_WATCH
+      case CMND_WATCH_MEMORY : {
+        /* After the answer, it streams until the host speaks again */
+        if (!MON::watch_setup()) break;
+        answer_transfer();
+        MON::watch_loop();
+        return;
+      }
+      #endif
+      #ifdef ENABLE_ADDFEATS_MAILBOX
+      case CMND_MAILBOX : {
+        /* After the answer, it streams until the host speaks again */
+        if (!MON::mailbox_setup()) break;
+        answer_transfer();
+        MON::mailbox_loop();
+        return;
+      }
+      #endif
+      #ifdef ENABLE_ADDFEATS_FILL
+      case CMND_FILL_MEMORY : {
+        /* Received packet error retransmission exception */
+        if (before_seqnum == packet.number) break;
+        fill_memory();
+        /* Keep the sequence number if completed successfully */
+        if (packet.body[MESSAGE_ID] == RSP_OK) before_seqnum = packet.number;
+        break;
+      }
+      #endif
+      #ifdef ENABLE_ADDFEATS_STREAM
+      case CMND_STREAM_MEMORY : {
+        /* The raw stream follows the answer, then one final answer */
+        if (!BLK::stream_setup()) break;
+        answer_transfer();
+        BLK::stream();
+        break;
+      }
+      #endif
+      #ifdef ENABLE_ADDFEATS_LOOPBACK
+      case CMND_LOOPBACK : {
+        loopback();
+        break;
+      }
+      #endif
+      #ifdef ENABLE_ADDFEATS_SWEEP
+      case CMND_UPDI_SWEEP : {
+        updi_sweep();
+        break;
+      }
+      #endif
+      #ifdef ENABLE_ADDFEATS_SERIAL
+      case CMND_SERIALIZE : {
+        /* Received packet error retransmission exception */
+        if (before_seqnum == packet.number) break;
+        /* Keep the sequence number if the record or template was written */
+        if (SER::command()) before_seqnum = packet.number;
+        break;
+      }
+      #endif
+      #ifdef ENABLE_ADDFEATS_WAIT
+      case CMND_WAIT_MEMORY : {
+        MON::wait_memory();
+        break;
+      }
+      #endif
+      #ifdef ENABLE_ADDFEATS_WRITE_BEHIND
+      case CMND_LEAVE_PROGMODE : {
+        /* The last page is answered before program mode ends */
+        set_response(write_settled() ? RSP_OK : RSP_FAILED);
+        break;
+      }
+      #endif
       case CMND_SET_UPDI_PARAMS :
       case CMND_SET_DEVICE_DESC : {
         set_descripter(message_id);
@@ -428,13 +887,19 @@ namespace JTAG2 {
       /* Returns affirmative for all unsupported commands */
       case CMND_SET_XMEGA_PARAMS :
       case CMND_ENTER_PROGMODE :
+      #ifndef ENABLE_ADDFEATS_WRITE_BEHIND
       case CMND_LEAVE_PROGMODE :
+      #endif
       case CMND_GO :
       case CMND_GET_SYNC : {
         set_response(RSP_OK);
         break;
       }
       case CMND_SIGN_OFF : {
+        #ifdef ENABLE_ADDFEATS_WRITE_BEHIND
+        /* The last page is answered before the target is released */
+        if (!write_settled()) set_response(RSP_FAILED);
+        #endif
         answer_transfer();
         flush();
         if (bit_is_set(UPDI_CONTROL, UPDI::UPDI_INFO_bp))
@@ -456,7 +921,7 @@ namespace JTAG2 {
  ******************/
 
 void JTAG2::setup (void) {
-  JTAG_USART.BAUD = pgm_read_word( &BAUD_TABLE[BAUD_19200] );
+  JTAG_USART.BAUD = pgm_read_word( &BAUD_TABLE[BAUD_19200] ) << SYS::clock_shift;
   JTAG_USART.CTRLA = JTAG_USART_CTRLA;
   JTAG_USART.CTRLC = JTAG_USART_CTRLC;
   JTAG_USART.CTRLB = JTAG_USART_OFF;
@@ -0,0 +1,312 @@
+/**
+ * @file MON.cpp
+ * @author askn (K.Sato) multix.jp
+ * @brief
+ * @version 0.1
+ * @date 2023-12-24
+ *
+ * @copyright Copyright (c) 2023 askn37 at github.com
+ *
+ */
+#include "Prototypes.h"
+#include <api/capsule.h>
+
+namespace MON {
+  #ifdef ENABLE_ADDFEATS_WATCH
+  struct watch_region_t {
+    uint16_t addr;
+    uint8_t len;
+  } watch_region[WATCH_REGIONS];
+  uint8_t watch_shadow[WATCH_SHADOW];
+  uint8_t watch_count = 0;
+  uint16_t watch_period;
+  bool watch_first;
+  #endif
+  #ifdef ENABLE_ADDFEATS_MAILBOX
+  uint16_t mailbox_addr;
+  uint16_t mailbox_period;
+  uint8_t mailbox_size;
+  uint8_t mailbox_tail;
+  #endif
+  #ifdef ENABLE_ADDFEATS_WAIT
+  uint16_t wait_addr;
+  uint8_t wait_value;
+  #endif
+}
+
+#if defined(ENABLE_ADDFEATS_WATCH) || defined(ENABLE_ADDFEATS_MAILBOX)
+
+/************************
+ * Target memory stream *
+ ************************/
+
+/*
+ * Every event has the same header
+ *   body[1]   : 0 = sampled, 1 = UPDI fault
+ *   body[2,3] : time stamp (1/1024 sec)
+ */
+
+void MON::stream_loop (uint8_t updi_cmd, uint8_t event_id, uint16_t period) {
+  uint16_t _stamp = TIM::Ticks() - period;
+  /* Any byte from the host ends the stream. It is left to packet_receive. */
+  while (bit_is_clear(JTAG_USART.STATUS, USART_RXCIF_bp)) {
+    uint16_t _now = TIM::Ticks();
+    wdt_reset();
+    if ((uint16_t)(_now - _stamp) < period) continue;
+    _stamp = _now;
+    bool _result = UPDI::runtime(updi_cmd);
+    /* Nothing new, nothing is sent */
+    if (_result && JTAG2::packet.size_word[0] == 4) continue;
+    if (!_result) JTAG2::packet.size_word[0] = 4;
+    JTAG2::packet.number = 0xFFFF;
+    JTAG2::packet.body[JTAG2::MESSAGE_ID] = event_id;
+    JTAG2::packet.body[1] = !_result;
+    _CAPS16(JTAG2::packet.body[2])->word = _now;
+    JTAG2::answer_transfer();
+  }
+}
+
+#endif
+
+#ifdef ENABLE_ADDFEATS_WATCH
+
+/*****************************
+ * Target memory watch setup *
+ *****************************/
+
+/*
+ * CMND_WATCH_MEMORY
+ *   body[1]   : number of regions (0 clears the watch list)
+ *   body[2,3] : sampling period (1/1024 sec)
+ *   body[4..] : { address (2), length (1) } x regions
+ */
+
+bool MON::watch_setup (void) {
+  uint8_t _count = JTAG2::packet.body[1];
+  uint16_t _period = _CAPS16(JTAG2::packet.body[2])->word;
+  uint8_t *p = &JTAG2::packet.body[4];
+  uint8_t _total = 0;
+
+  /* Only in terminal mode, and the UPDI must be accessible */
+  if (bit_is_clear(UPDI_CONTROL, UPDI::UPDI_TERM_bp)
+   || bit_is_clear(UPDI_CONTROL, UPDI::UPDI_INFO_bp)) {
+    JTAG2::set_response(JTAG2::RSP_ILLEGAL_MCU_STATE);
+    return false;
+  }
+  if (_count > WATCH_REGIONS || _period == 0
+   || JTAG2::packet.size_word[0] != 4 + _count * 3) {
+    JTAG2::set_response(JTAG2::RSP_ILLEGAL_VALUE);
+    return false;
+  }
+  for (uint8_t i = 0; i < _count; i++) {
+    uint8_t _len = p[2];
+    if (_len == 0 || (uint16_t)(_total + _len) > WATCH_SHADOW) {
+      JTAG2::set_response(JTAG2::RSP_ILLEGAL_MEMORY_RANGE);
+      return false;
+    }
+    watch_region[i].addr = _CAPS16(p[0])->word;
+    watch_region[i].len = _len;
+    _total += _len;
+    p += 3;
+  }
+  watch_count = _count;
+  watch_period = _period;
+  watch_first = true;
+  return _count != 0;
+}
+
+/****************************
+ * Target memory difference *
+ ****************************/
+
+/*
+ * EVT_WATCH_MEMORY
+ *   body[4..] : { region, offset, length, data[length] } x changes
+ */
+
+bool MON::watch_sample (void) {
+  uint8_t *q = &JTAG2::packet.body[4];
+  uint8_t *s = &watch_shadow[0];
+  /* The tail of the packet buffer is used as the reading area */
+  uint8_t *t = &JTAG2::packet.body[JTAG2::MAX_BODY_SIZE - WATCH_SHADOW];
+  for (uint8_t i = 0; i < watch_count; i++) {
+    uint8_t _len = watch_region[i].len;
+    if (!UPDI::lds8(watch_region[i].addr, t, _len)) return false;
+    uint8_t j = 0;
+    while (j < _len) {
+      if (!watch_first && s[j] == t[j]) { j++; continue; }
+      /* Start of a changed run : short unchanged gaps are merged */
+      uint8_t *r = q;
+      *q++ = i;
+      *q++ = j;
+      q++;
+      uint8_t _gap = 0;
+      uint8_t _run = 0;
+      do {
+        if (!watch_first && s[j] == t[j]) {
+          if (++_gap > 3) break;
+        }
+        else {
+          while (_gap) { *q++ = t[j - _gap]; _run++; _gap--; }
+          *q++ = t[j];
+          _run++;
+          s[j] = t[j];
+        }
+      } while (++j < _len);
+      r[2] = _run;
+    }
+    s += _len;
+  }
+  watch_first = false;
+  JTAG2::packet.size_word[0] = q - &JTAG2::packet.body[0];
+  return true;
+}
+
+void MON::watch_loop (void) {
+  stream_loop(UPDI::UPDI_CMD_WATCH, JTAG2::EVT_WATCH_MEMORY, watch_period);
+}
+
+#endif
+
+#ifdef ENABLE_ADDFEATS_MAILBOX
+
+/************************
+ * Target mailbox setup *
+ ************************/
+
+/*
+ * CMND_MAILBOX
+ *   body[1,2] : mailbox address in target data space
+ *   body[3]   : ring buffer size (2 to 255)
+ *   body[4,5] : polling period (1/1024 sec, 0 is continuous)
+ *
+ * Target mailbox layout
+ *   +0 : head (written by the target)
+ *   +1 : tail (written by UPDI4AVR)
+ *   +2 : ring buffer
+ */
+
+bool MON::mailbox_setup (void) {
+  if (JTAG2::packet.size_word[0] != 6 || JTAG2::packet.body[3] < 2) {
+    JTAG2::set_response(JTAG2::RSP_ILLEGAL_VALUE);
+    return false;
+  }
+  mailbox_addr = _CAPS16(JTAG2::packet.body[1])->word;
+  mailbox_size = JTAG2::packet.body[3];
+  mailbox_period = _CAPS16(JTAG2::packet.body[4])->word;
+  /* The tail is fetched from the target on the first drain */
+  mailbox_tail = 0xFF;
+  /* The target must be running while the UPDI stays accessible */
+  if (!UPDI::runtime(UPDI::UPDI_CMD_ATTACH)) {
+    JTAG2::set_response(JTAG2::RSP_ILLEGAL_MCU_STATE);
+    return false;
+  }
+  return true;
+}
+
+/************************
+ * Target mailbox drain *
+ ************************/
+
+/*
+ * EVT_MAILBOX
+ *   body[4..] : received bytes
+ */
+
+bool MON::mailbox_drain (void) {
+  uint8_t *q = &JTAG2::packet.body[4];
+  uint8_t _tail = mailbox_tail;
+  if (_tail == 0xFF) {
+    _tail = UPDI::ld8(mailbox_addr + 1);
+    if (UPDI_LASTH || _tail >= mailbox_size) return false;
+    mailbox_tail = _tail;
+  }
+  uint8_t _head = UPDI::ld8(mailbox_addr);
+  if (UPDI_LASTH || _head >= mailbox_size) return false;
+  if (_head != _tail) {
+    /* Wrap around is read in two bursts */
+    if (_head < _tail) {
+      uint8_t _len = mailbox_size - _tail;
+      if (!UPDI::lds8(mailbox_addr + 2 + _tail, q, _len)) return false;
+      q += _len;
+      _tail = 0;
+    }
+    if (_head != _tail) {
+      uint8_t _len = _head - _tail;
+      if (!UPDI::lds8(mailbox_addr + 2 + _tail, q, _len)) return false;
+      q += _len;
+    }
+    /* Release the ring buffer to the target */
+    if (!UPDI::st8(mailbox_addr + 1, _head)) return false;
+    mailbox_tail = _head;
+  }
+  JTAG2::packet.size_word[0] = q - &JTAG2::packet.body[0];
+  return true;
+}
+
+void MON::mailbox_loop (void) {
+  stream_loop(UPDI::UPDI_CMD_MAILBOX, JTAG2::EVT_MAILBOX, mailbox_period);
+}
+
+#endif
+
+#ifdef ENABLE_ADDFEATS_WAIT
+
+/**********************
+ * Target memory wait *
+ **********************/
+
+/*
+ * CMND_WAIT_MEMORY
+ *   body[1,2] : address in target data space
+ *   body[3]   : mask
+ *   body[4]   : expected value (after masking)
+ *   body[5,6] : timeout (1/1024 sec)
+ *
+ * RSP_MEMORY
+ *   body[1]   : 0 = matched, 1 = timed out
+ *   body[2]   : last value read
+ *   body[3,4] : elapsed time (1/1024 sec)
+ */
+
+bool MON::wait_poll (void) {
+  wait_value = UPDI::ld8(wait_addr);
+  return UPDI_LASTH == 0;
+}
+
+void MON::wait_memory (void) {
+  if (JTAG2::packet.size_word[0] != 7) {
+    JTAG2::set_response(JTAG2::RSP_ILLEGAL_VALUE);
+    return;
+  }
+  wait_addr = _CAPS16(JTAG2::packet.body[1])->word;
+  uint8_t _mask = JTAG2::packet.body[3];
+  uint8_t _expect = JTAG2::packet.body[4] & _mask;
+  uint16_t _timeout = _CAPS16(JTAG2::packet.body[5])->word;
+  /* The target keeps running, and only the UPDI is re-entered */
+  if (!UPDI::runtime(UPDI::UPDI_CMD_ATTACH)) {
+    JTAG2::set_response(JTAG2::RSP_ILLEGAL_MCU_STATE);
+    return;
+  }
+  uint16_t _start = TIM::Ticks();
+  uint16_t _elapsed;
+  bool _timedout;
+  /* Each poll has its own UPDI timeout, so long waits are allowed */
+  do {
+    if (!UPDI::runtime(UPDI::UPDI_CMD_WAIT)) {
+      JTAG2::set_response(JTAG2::RSP_ILLEGAL_MCU_STATE);
+      return;
+    }
+    _elapsed = TIM::Ticks() - _start;
+    _timedout = _elapsed >= _timeout;
+  } while ((wait_value & _mask) != _expect && !_timedout);
+  JTAG2::packet.body[JTAG2::MESSAGE_ID] = JTAG2::RSP_MEMORY;
+  JTAG2::packet.body[1] = (wait_value & _mask) != _expect;
+  JTAG2::packet.body[2] = wait_value;
+  _CAPS16(JTAG2::packet.body[3])->word = _elapsed;
+  JTAG2::packet.size_word[0] = 5;
+}
+
+#endif
+
+// end of code
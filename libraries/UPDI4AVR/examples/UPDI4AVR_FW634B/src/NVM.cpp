@@ -24,6 +24,29 @@ namespace NVM {
   bool write_fuse (uint16_t addr, uint8_t data);
   uint16_t before_addr = ~0;
 
+  #ifdef ENABLE_ADDFEATS_WRITE_BEHIND
+  /* The last flash page is still being programmed */
+  bool write_pending = false;
+  /* A page failed, sticky until the next chip erase */
+  bool write_error = false;
+  #endif
+
+  #ifdef ENABLE_ADDFEATS_PREFETCH
+  /* Read-ahead of the next flash block of a sequential read */
+  uint8_t prefetch_buf[512];
+  uint32_t prefetch_addr;         /* the block in prefetch_buf */
+  size_t prefetch_len = 0;        /* 0 is nothing held */
+  uint32_t prefetch_next = ~0;    /* where the last flash read ended */
+  size_t prefetch_size;           /* the size of the last flash read */
+  bool prefetch_ahead = false;    /* read the next block after the answer */
+
+  inline bool is_flash (uint8_t mem_type) {
+    return mem_type == JTAG2::MTYPE_FLASH_PAGE
+        || mem_type == JTAG2::MTYPE_XMEGA_APP_FLASH
+        || mem_type == JTAG2::MTYPE_XMEGA_BOOT_FLASH;
+  }
+  #endif
+
   bool check_pagesize (uint16_t seed, uint16_t test) {
     while (test != seed) {
       seed >>= 1;
@@ -109,6 +132,22 @@ namespace NVM {
    * EEPROM region word type writing *
    ***********************************/
 
+  #ifdef ENABLE_ADDFEATS_EEPROM_DIFF
+  /* The tail of the packet buffer holds the destination read back */
+  uint8_t *const eeprom_work = &JTAG2::packet.body[JTAG2::MAX_BODY_SIZE - 64];
+
+  /* Call only after NVMCTRL is no longer busy */
+  bool eeprom_differs (uint32_t start_addr, uint8_t *data, uint8_t byte_count) {
+    uint8_t *t = eeprom_work;
+    /* If it cannot be read, it is simply written */
+    if (!UPDI::lds8(start_addr, t, byte_count)) return true;
+    do {
+      if (*t++ != *data++) return true;
+    } while (--byte_count);
+    return false;
+  }
+  #endif
+
   bool write_eeprom_v4 (uint32_t start_addr, uint8_t *data, size_t byte_count) {
     /* NVMCTRL version 4 */
     /* This version cannot be written in bulk transfer */
@@ -118,6 +157,10 @@ namespace NVM {
       set_response(JTAG2::RSP_ILLEGAL_MEMORY_RANGE);
       return true;
     }
+    #ifdef ENABLE_ADDFEATS_EEPROM_DIFF
+    nvm_wait_v3();
+    if (!eeprom_differs(start_addr, data, byte_count)) return true;
+    #endif
     if (!nvm_ctrl_v3(NVM_V2_CMD_EEERWR)) return false;
 
     if (byte_count == 1) UPDI::st8(start_addr, *data);
@@ -134,6 +177,10 @@ namespace NVM {
       set_response(JTAG2::RSP_ILLEGAL_MEMORY_RANGE);
       return true;
     }
+    #ifdef ENABLE_ADDFEATS_EEPROM_DIFF
+    nvm_wait_v3();
+    if (!eeprom_differs(start_addr, data, byte_count)) return true;
+    #endif
     if (!nvm_ctrl_v3(NVM_V3_CMD_EEPBCLR)) return false;
 
     if (byte_count == 1) UPDI::st8(start_addr, *data);
@@ -151,6 +198,10 @@ namespace NVM {
       set_response(JTAG2::RSP_ILLEGAL_MEMORY_RANGE);
       return true;
     }
+    #ifdef ENABLE_ADDFEATS_EEPROM_DIFF
+    nvm_wait();
+    if (!eeprom_differs(start_addr, data, byte_count)) return true;
+    #endif
     if (!nvm_ctrl_v2(NVM_V2_CMD_EEERWR)) return false;
 
     if (byte_count == 1) UPDI::st8(start_addr, *data);
@@ -169,8 +220,23 @@ namespace NVM {
     }
     nvm_wait();
 
+    #ifdef ENABLE_ADDFEATS_EEPROM_DIFF
+    if (!eeprom_differs(start_addr, data, byte_count)) return true;
+    /* Only the bytes loaded into the page buffer are erased and written */
+    uint8_t *t = eeprom_work;
+    uint8_t i = 0;
+    while (i < byte_count) {
+      if (t[i] == data[i]) { i++; continue; }
+      uint8_t j = i;
+      while (++j < byte_count && t[j] != data[j]);
+      if (j - i == 1) UPDI::st8(start_addr + i, data[i]);
+      else UPDI::sts8rsd(start_addr + i, &data[i], j - i);
+      i = j;
+    }
+    #else
     if (byte_count == 1) UPDI::st8(start_addr, *data);
     else UPDI::sts8rsd(start_addr, data, byte_count);
+    #endif
 
     return nvm_ctrl(NVM_CMD_ERWP);
   }
@@ -196,25 +262,30 @@ namespace NVM {
     else if ((byte_count - 1) >> 8) UPDI::sts16rsd(start_addr, data, byte_count);
     else UPDI::sts8rsd(start_addr, data, byte_count);
 
+    #ifdef ENABLE_ADDFEATS_WRITE_BEHIND
+    /* NOCMD is issued by write_complete() */
+    return write_pending = true;
+    #else
     return nvm_ctrl_v3(NVM_V2_CMD_NOCMD);
+    #endif
   }
 
   bool write_flash_v3 (uint32_t start_addr, uint8_t *data, size_t byte_count, bool is_bound) {
     /* NVMCTRL version 3 or 5 */
     /* If the chip is not erased, erase the page. */
     /* However, only when the beginning of the page boundary is addressed */
-    if (is_bound) {
-      nvm_wait_v3();
-      if (!UPDI::st8(start_addr, 0xFF)) return false;
-      if (!nvm_ctrl_v3(NVM_V3_CMD_FLPER)) return false;
-    }
-    else if (!nvm_ctrl_v3(NVM_V3_CMD_FLPBCLR)) return false;
-    nvm_wait_v3();
+    /* The erase is done together with the write by a single FLPERW. */
+    if (!nvm_ctrl_v3(NVM_V3_CMD_FLPBCLR)) return false;
 
     if (byte_count == 1) UPDI::st8(start_addr, *data);
     else UPDI::sts8rsd(start_addr, data, byte_count);
 
-    return nvm_ctrl_v3(NVM_V3_CMD_FLPW);
+    #ifdef ENABLE_ADDFEATS_WRITE_BEHIND
+    if (!nvm_ctrl_v3(is_bound ? NVM_V3_CMD_FLPERW : NVM_V3_CMD_FLPW)) return false;
+    return write_pending = true;
+    #else
+    return nvm_ctrl_v3(is_bound ? NVM_V3_CMD_FLPERW : NVM_V3_CMD_FLPW);
+    #endif
   }
 
   bool write_flash_v2 (uint32_t start_addr, uint8_t *data, size_t byte_count, bool is_bound) {
@@ -232,7 +303,12 @@ namespace NVM {
     else if ((byte_count - 1) >> 8) UPDI::sts16rsd(start_addr, data, byte_count);
     else UPDI::sts8rsd(start_addr, data, byte_count);
 
+    #ifdef ENABLE_ADDFEATS_WRITE_BEHIND
+    /* NOCMD is issued by write_complete() */
+    return write_pending = true;
+    #else
     return nvm_ctrl_v2(NVM_V2_CMD_NOCMD);
+    #endif
   }
 
   bool write_flash_v0 (uint32_t start_addr, uint8_t *data, size_t byte_count, bool is_bound) {
@@ -248,12 +324,228 @@ namespace NVM {
     if (byte_count == 1) UPDI::st8(start_addr, *data);
     else UPDI::sts8rsd(start_addr, data, byte_count);
 
+    #ifdef ENABLE_ADDFEATS_WRITE_BEHIND
+    if (!nvm_ctrl(NVM_CMD_ERWP)) return false;
+    return write_pending = true;
+    #else
     return nvm_ctrl(NVM_CMD_ERWP);
+    #endif
+  }
+
+  bool write_flash (uint32_t start_addr, uint8_t *data, size_t byte_count, bool is_bound) {
+    /* NVMCTRL processing steps vary depending on the version. */
+    if (bit_is_set(UPDI_NVMCTRL, UPDI::UPDI_GEN4_bp))
+      return write_flash_v4(start_addr, data, byte_count, is_bound);
+    else if (bit_is_set(UPDI_NVMCTRL, UPDI::UPDI_GEN3_bp))
+      return write_flash_v3(start_addr, data, byte_count, is_bound);
+    else if (bit_is_set(UPDI_NVMCTRL, UPDI::UPDI_GEN2_bp))
+      return write_flash_v2(start_addr, data, byte_count, is_bound);
+    else
+      return write_flash_v0(start_addr, data, byte_count, is_bound);
+  }
+
+  #ifdef ENABLE_ADDFEATS_WRITE_VERIFY
+  /* Read the page back once programmed.                 */
+  /* A mismatch answers RSP_FAILED with its page offset. */
+  bool verify_flash (uint32_t start_addr, uint8_t *data, size_t byte_count) {
+    uint8_t work[32];
+    uint16_t offset = 0;
+    #ifdef ENABLE_ADDFEATS_WRITE_BEHIND
+    write_complete();
+    #else
+    if (bit_is_set(UPDI_NVMCTRL, UPDI::UPDI_GEN4_bp)
+      || bit_is_set(UPDI_NVMCTRL, UPDI::UPDI_GEN3_bp)) nvm_wait_v3();
+    else nvm_wait();
+    #endif
+    do {
+      uint8_t _len = byte_count < sizeof(work) ? byte_count : sizeof(work);
+      if (!UPDI::lds8(start_addr + offset, work, _len)) return false;
+      for (uint8_t i = 0; i < _len; i++, offset++) {
+        if (work[i] != *data++) {
+          JTAG2::packet.body[JTAG2::MESSAGE_ID] = JTAG2::RSP_FAILED;
+          _CAPS16(JTAG2::packet.body[JTAG2::RSP_DATA])->word = offset;
+          JTAG2::packet.size_word[0] = 3;
+          return true;
+        }
+      }
+      byte_count -= _len;
+    } while (byte_count);
+    return true;
+  }
+  #endif
+
+  #ifdef ENABLE_ADDFEATS_REGION_ERASE
+  /*************************
+   * Region erase geometry *
+   *************************/
+
+  /* The start of flash in the UPDI address space */
+  uint32_t flash_base (void) {
+    if (bit_is_set(UPDI_NVMCTRL, UPDI::UPDI_GEN2_bp)) return 0x800000;
+    return bit_is_set(UPDI_NVMCTRL, UPDI::UPDI_LOWF_bp) ? 0x4000 : 0x8000;
+  }
+
+  /* The flash size from the signature $1E:$9x:$NN, 0 if unknown */
+  uint32_t flash_size (void) {
+    uint8_t _sig = UPDI::ld8(1 + (bit_is_set(UPDI_NVMCTRL, UPDI::UPDI_GEN4_bp)
+      || bit_is_set(UPDI_NVMCTRL, UPDI::UPDI_GEN5_bp) ? BASE45_SIGROW : BASE_SIGROW));
+    if ((_sig & 0xF0) != 0x90 || (_sig & 15) > 7) return 0;
+    /* megaAVR 0-series : $96 is 48KiB */
+    if (bit_is_set(UPDI_NVMCTRL, UPDI::UPDI_LOWF_bp) && _sig == 0x96) return 0xC000;
+    return 1024UL << (_sig & 15);
+  }
+
+  /* The boot section size from the fuse, 0 is all boot section */
+  uint32_t boot_size (void) {
+    /* version 0 : BOOTEND in 256 bytes */
+    if (bit_is_clear(UPDI_NVMCTRL, UPDI::UPDI_GEN2_bp))
+      return (uint32_t)UPDI::ld8(BASE23_FUSE + 8) << 8;
+    /* version 2,3,4,5 : BOOTSIZE in 512 bytes */
+    return (uint32_t)UPDI::ld8(BASE_FUSE + 8) << 9;
+  }
+
+  /*********************************
+   * Flash and EEPROM region erase *
+   *********************************/
+
+  /* Erase 1,2,4,8,16 or 32 pages from an aligned address */
+  bool erase_flash (uint32_t start_addr, uint8_t pages) {
+    /* FLPER to FLMPER32 are the same numbers in every version */
+    uint8_t _cmd = NVM_V2_CMD_FLPER;
+    while (pages >>= 1) _cmd++;
+    if (bit_is_set(UPDI_NVMCTRL, UPDI::UPDI_GEN4_bp)) {
+      /* version 4 : command, then the address */
+      if (!nvm_ctrl_v3(_cmd)) return false;
+      return UPDI::st8(start_addr, 0xFF);
+    }
+    else if (bit_is_set(UPDI_NVMCTRL, UPDI::UPDI_GEN3_bp)) {
+      /* version 3,5 : the address, then command */
+      /* The write of the command starts the erase, so it is taken back */
+      /* for the next group, which may be the same command again.        */
+      nvm_wait_v3();
+      if (!UPDI::st8(start_addr, 0xFF)) return false;
+      if (!nvm_ctrl_v3(_cmd)) return false;
+      return nvm_ctrl_v3(NVM_V2_CMD_NOCMD);
+    }
+    else if (bit_is_set(UPDI_NVMCTRL, UPDI::UPDI_GEN2_bp)) {
+      /* version 2 : command, then the address */
+      if (!nvm_ctrl_v2(_cmd)) return false;
+      return UPDI::st8(start_addr, 0xFF);
+    }
+    /* version 0 : one page at a time from the page buffer */
+    nvm_wait();
+    if (!nvm_ctrl(NVM_CMD_PBC)) return false;
+    nvm_wait();
+    if (!UPDI::st8(start_addr, 0xFF)) return false;
+    return nvm_ctrl(NVM_CMD_ER);
+  }
+
+  /* Erase the pages in start_addr to end_addr with the largest groups */
+  bool erase_flash_range (uint32_t start_addr, uint32_t end_addr) {
+    uint16_t _page = JTAG2::updi_desc.flash_page_size;
+    while (start_addr < end_addr) {
+      uint8_t _pages = 1;
+      /* Multi-page erase is not in version 0 */
+      if (bit_is_set(UPDI_NVMCTRL, UPDI::UPDI_GEN2_bp)) {
+        uint16_t _index = start_addr / _page;
+        while (_pages < 32 && !(_index & _pages)
+          && start_addr + (uint32_t)_page * (_pages << 1) <= end_addr) _pages <<= 1;
+      }
+      if (!erase_flash(start_addr, _pages)) return false;
+      start_addr += (uint32_t)_page * _pages;
+    }
+    return true;
+  }
+
+  /* Erase one EEPROM page, or the USERROW of version 0 */
+  bool erase_eeprom_page (uint32_t start_addr, uint8_t byte_count) {
+    if (bit_is_set(UPDI_NVMCTRL, UPDI::UPDI_GEN3_bp)
+     && bit_is_clear(UPDI_NVMCTRL, UPDI::UPDI_GEN4_bp)) {
+      /* version 3,5 : the address, then command */
+      nvm_wait_v3();
+      if (!UPDI::st8(start_addr, 0xFF)) return false;
+      return nvm_ctrl_v3(NVM_V3_CMD_EEPER);
+    }
+    else if (bit_is_set(UPDI_NVMCTRL, UPDI::UPDI_GEN2_bp)) {
+      /* version 2,4 : EEBER to EEMBER32, command then the address */
+      uint8_t _cmd = NVM_V2_CMD_EEBER;
+      while ((byte_count >>= 1) && _cmd < NVM_V2_CMD_EEMBER32) _cmd++;
+      if (bit_is_set(UPDI_NVMCTRL, UPDI::UPDI_GEN4_bp)) {
+        if (!nvm_ctrl_v3(_cmd)) return false;
+      }
+      else if (!nvm_ctrl_v2(_cmd)) return false;
+      return UPDI::st8(start_addr, 0xFF);
+    }
+    /* version 0 : only the bytes loaded into the page buffer are erased */
+    uint8_t _work[64];
+    if (byte_count > sizeof(_work)) byte_count = sizeof(_work);
+    for (uint8_t i = 0; i < byte_count; i++) _work[i] = 0xFF;
+    nvm_wait();
+    if (!nvm_ctrl(NVM_CMD_PBC)) return false;
+    nvm_wait();
+    if (!UPDI::sts8(start_addr, _work, byte_count)) return false;
+    return nvm_ctrl(NVM_CMD_ER);
+  }
+
+  bool erase_eeprom (void) {
+    if (bit_is_set(UPDI_NVMCTRL, UPDI::UPDI_GEN4_bp)
+      || bit_is_set(UPDI_NVMCTRL, UPDI::UPDI_GEN3_bp))
+      return nvm_ctrl_v3(NVM_V3_CMD_EECHER);
+    else if (bit_is_set(UPDI_NVMCTRL, UPDI::UPDI_GEN2_bp))
+      return nvm_ctrl_v2(NVM_V2_CMD_EECHER);
+    nvm_wait();
+    return nvm_ctrl(NVM_CMD_EEER);
   }
+  #endif
 }
 
 /*** Global functions ***/
 
+#ifdef ENABLE_ADDFEATS_PREFETCH
+void NVM::prefetch_drop (void) {
+  prefetch_len = 0;
+  prefetch_next = ~0;
+  prefetch_ahead = false;
+}
+
+/* Runs while the answer of the last read is sent */
+bool NVM::prefetch_run (void) {
+  prefetch_ahead = false;
+  if (!UPDI::lds_idle(prefetch_next, prefetch_buf, prefetch_size, JTAG2::answer_step)) return false;
+  prefetch_addr = prefetch_next;
+  prefetch_len = prefetch_size;
+  return true;
+}
+#endif
+
+#ifdef ENABLE_ADDFEATS_WRITE_BEHIND
+/* Wait for the flash page left programming and check its result. */
+/* Called before every UPDI operation, including the sign-off.    */
+
+bool NVM::write_complete (void) {
+  if (!write_pending) return !write_error;
+  write_pending = false;
+  if (bit_is_set(UPDI_NVMCTRL, UPDI::UPDI_GEN4_bp)
+    || bit_is_set(UPDI_NVMCTRL, UPDI::UPDI_GEN3_bp)) {
+    /* version 3,4,5 : STATUS.ERROR */
+    if (nvm_wait_v3() & 0x70) write_error = true;
+    /* version 4 : leave FLWR */
+    if (bit_is_set(UPDI_NVMCTRL, UPDI::UPDI_GEN4_bp)
+      && !nvm_ctrl_change(NVM_V2_CMD_NOCMD)) write_error = true;
+  }
+  else if (bit_is_set(UPDI_NVMCTRL, UPDI::UPDI_GEN2_bp)) {
+    /* version 2 : STATUS.ERROR, then leave FLWR */
+    if (nvm_wait() & 0x70) write_error = true;
+    if (!nvm_ctrl_change(NVM_V2_CMD_NOCMD)) write_error = true;
+  }
+  else {
+    /* version 0 : STATUS.WRERROR */
+    if (nvm_wait() & 4) write_error = true;
+  }
+  return !write_error;
+}
+#endif
+
 /* Perform a chip erase using NVMCTRL.             */
 /* To do this, you must first enable program mode. */
 /* Otherwise, you must use UPDI::chip_erase().     */
@@ -282,9 +574,105 @@ bool NVM::chip_erase (void) {
     if (!nvm_ctrl_v2(NVM_CMD_NOCMD)) return false;
   }
   bit_set(UPDI_CONTROL, UPDI::UPDI_ERFM_bp);
+  #ifdef ENABLE_ADDFEATS_WRITE_BEHIND
+  write_error = false;
+  #endif
   return true;
 }
 
+#ifdef ENABLE_ADDFEATS_REGION_ERASE
+/* Erase a section or a page of CMND_XMEGA_ERASE in program mode.   */
+/* Page addresses are absolute, as for MTYPE_FLASH_PAGE.            */
+/* The boot section ends at BOOTEND or BOOTSIZE, and the rest is    */
+/* the application section up to the flash size of the signature.  */
+/* A BOOTEND or BOOTSIZE of 0 makes the whole flash boot section.   */
+
+bool NVM::region_erase (void) {
+  uint8_t mode = JTAG2::packet.body[JTAG2::MEM_TYPE];
+  uint32_t start_addr = _CAPS32(JTAG2::packet.body[JTAG2::ERASE_ADDRESS])->dword;
+  uint16_t page = JTAG2::updi_desc.flash_page_size;
+  uint8_t eeprom_page = JTAG2::updi_desc.eeprom_page_size;
+  bool _result;
+
+  /* Only program mode is allowed. */
+  if (bit_is_clear(UPDI_CONTROL, UPDI::UPDI_PROG_bp)) return false;
+
+  /* Without the page size nothing can be located */
+  if (page < 2 || (page & (page - 1))) {
+    set_response(JTAG2::RSP_ILLEGAL_MEMORY_RANGE);
+    return true;
+  }
+  if (!eeprom_page) eeprom_page = 1;
+
+  switch (mode) {
+    case JTAG2::XMEGA_ERASE_APP :
+    case JTAG2::XMEGA_ERASE_BOOT : {
+      uint32_t base = flash_base();
+      uint32_t size = flash_size();
+      uint32_t boot = boot_size();
+      if (!size) {
+        set_response(JTAG2::RSP_ILLEGAL_MEMORY_RANGE);
+        return true;
+      }
+      if (!boot || boot > size) boot = size;
+      if (mode == JTAG2::XMEGA_ERASE_APP)
+        _result = erase_flash_range(base + boot, base + size);
+      else
+        _result = erase_flash_range(base, base + boot);
+      break;
+    }
+    case JTAG2::XMEGA_ERASE_APP_PAGE :
+    case JTAG2::XMEGA_ERASE_BOOT_PAGE : {
+      start_addr &= ~(uint32_t)(page - 1);
+      _result = erase_flash(start_addr, 1);
+      /* Writing into this page need not erase it again */
+      /* Version 0 always uses ERWP, so it is left as it is */
+      if (bit_is_set(UPDI_NVMCTRL, UPDI::UPDI_GEN2_bp))
+        before_addr = (start_addr >> 1) & ~((page - 1) >> 1);
+      break;
+    }
+    case JTAG2::XMEGA_ERASE_EEPROM : {
+      _result = erase_eeprom();
+      break;
+    }
+    case JTAG2::XMEGA_ERASE_EEPROM_PAGE : {
+      start_addr &= ~(uint32_t)(eeprom_page - 1);
+      _result = erase_eeprom_page(start_addr, eeprom_page);
+      break;
+    }
+    case JTAG2::XMEGA_ERASE_USERROW : {
+      /* An address of 0 is the USERROW of the series */
+      if (bit_is_clear(UPDI_NVMCTRL, UPDI::UPDI_GEN2_bp)) {
+        /* version 0 : USERROW is written like EEPROM */
+        if (!start_addr) start_addr = BASE23_USERROW;
+        _result = erase_eeprom_page(start_addr, eeprom_page);
+      }
+      else {
+        /* version 2,3,4,5 : USERROW is a flash page */
+        if (!start_addr) start_addr = bit_is_set(UPDI_NVMCTRL, UPDI::UPDI_GEN3_bp)
+          || bit_is_set(UPDI_NVMCTRL, UPDI::UPDI_GEN4_bp) ? BASE45_USERROW : BASE_USERROW;
+        _result = erase_flash(start_addr, 1);
+      }
+      break;
+    }
+    default : {
+      set_response(JTAG2::RSP_ILLEGAL_MEMORY_TYPE);
+      return true;
+    }
+  }
+  if (!_result) return false;
+
+  /* Wait for the end, then leave the command */
+  if (bit_is_set(UPDI_NVMCTRL, UPDI::UPDI_GEN4_bp)
+    || bit_is_set(UPDI_NVMCTRL, UPDI::UPDI_GEN3_bp))
+    return nvm_ctrl_v3(NVM_V2_CMD_NOCMD);
+  else if (bit_is_set(UPDI_NVMCTRL, UPDI::UPDI_GEN2_bp))
+    return nvm_ctrl_v2(NVM_V2_CMD_NOCMD);
+  nvm_wait();
+  return true;
+}
+#endif
+
 /***********************
  * Memory reading core *
  ***********************/
@@ -327,6 +715,24 @@ bool NVM::read_memory (uint32_t start_addr, size_t byte_count) {
     return true;
   }
 
+  #ifdef ENABLE_ADDFEATS_PREFETCH
+  if (is_flash(JTAG2::packet.body[JTAG2::MEM_TYPE])) {
+    /* A read that continues the last one is followed by another */
+    prefetch_ahead = start_addr == prefetch_next;
+    prefetch_next = start_addr + byte_count;
+    /* Over 256 bytes lds_idle() reads words, so only an even size is read ahead */
+    prefetch_size = (byte_count >> 8) ? (byte_count & ~1) : byte_count;
+    if (prefetch_len == byte_count && prefetch_addr == start_addr) {
+      uint8_t *t = prefetch_buf;
+      prefetch_len = 0;
+      do { *data++ = *t++; } while (--byte_count);
+      return true;
+    }
+  }
+  else prefetch_drop();
+  prefetch_len = 0;
+  #endif
+
   if ((byte_count - 1) >> 8)
     return UPDI::lds16(start_addr, data, byte_count);
   else
@@ -349,6 +755,14 @@ bool NVM::write_memory (void) {
     mem_type = JTAG2::MTYPE_SRAM;
   }
 
+  #ifdef ENABLE_ADDFEATS_WRITE_BEHIND
+  /* A page failed behind the answer : refuse further writes */
+  if (write_error) {
+    set_response(JTAG2::RSP_FAILED);
+    return true;
+  }
+  #endif
+
   /* Can only be written to USERROW on locked devices */
   /* This write is only allowed in multiples of 32 bytes */
   if (bit_is_set(UPDI_CONTROL, UPDI::UPDI_INFO_bp)
@@ -391,15 +805,12 @@ bool NVM::write_memory (void) {
         before_addr = block_addr;
       }
 
-      /* NVMCTRL processing steps vary depending on the version. */
-      if (bit_is_set(UPDI_NVMCTRL, UPDI::UPDI_GEN4_bp))
-        return write_flash_v4(start_addr, data, byte_count, is_bound);
-      else if (bit_is_set(UPDI_NVMCTRL, UPDI::UPDI_GEN3_bp))
-        return write_flash_v3(start_addr, data, byte_count, is_bound);
-      else if (bit_is_set(UPDI_NVMCTRL, UPDI::UPDI_GEN2_bp))
-        return write_flash_v2(start_addr, data, byte_count, is_bound);
-      else
-        return write_flash_v0(start_addr, data, byte_count, is_bound);
+      #ifdef ENABLE_ADDFEATS_WRITE_VERIFY
+      if (!write_flash(start_addr, data, byte_count, is_bound)) return false;
+      return verify_flash(start_addr, data, byte_count);
+      #else
+      return write_flash(start_addr, data, byte_count, is_bound);
+      #endif
     }
   }
 
@@ -25,6 +25,11 @@
   #include "BUILD_STOP"
 #endif
 
+#if defined(ENABLE_ADDFEATS_PREFETCH) && (INTERNAL_SRAM_SIZE < 3072)
+  #warning ENABLE_ADDFEATS_PREFETCH is ignored with less than SRAM 3KB
+  #undef ENABLE_ADDFEATS_PREFETCH
+#endif
+
 /*****************************
  * UPDI4AVR Firmware Version *
  *****************************/
@@ -62,12 +67,22 @@ namespace SYS {
   void init (void);
   void setup (void);
   uint16_t get_vcc (void);
+  #ifdef ENABLE_CLOCK_SCALING
+  extern uint8_t clock_shift;
+  #else
+  const uint8_t clock_shift = 0;
+  #endif
   void System_Reset (void);
   void ready (void);
   void PG_Enable (void);
   void PG_Disable (void);
   void RTS_Enable (void);
   void RTS_Disable (void);
+  void Handover_Start (void);
+  void Handover_Cancel (void);
+  bool Handover_Pending (void);
+  bool Handover_Expired (void);
+  void Handover (void);
   void LED_Invert (void);
   void WDT_SET (uint8_t _wdt_period);
   void WDT_OFF (void);
@@ -81,6 +96,7 @@ namespace TIM {
   void setup (void);
   void Timeout_Start (uint16_t _count);
   void Timeout_Stop (void) __attribute__ ((noinline));
+  uint16_t Ticks (void);
   void LED_HeartBeat (void);
   void LED_Flash (void);
   void LED_Blink (void);
@@ -218,8 +234,34 @@ namespace UPDI {
     , UPDI_CMD_WRITE_MEMORY     = 2
     , UPDI_CMD_ERASE            = 3
     , UPDI_CMD_GO               = 4
+    , UPDI_CMD_WATCH            = 5
+    , UPDI_CMD_MAILBOX          = 6
+    #if defined(ENABLE_ADDFEATS_MAILBOX) || defined(ENABLE_ADDFEATS_WAIT)
+    , UPDI_CMD_ATTACH           = 7
+    #endif
+    , UPDI_CMD_WAIT             = 8
+    , UPDI_CMD_SWEEP            = 9
+    , UPDI_CMD_PREFETCH         = 10
+    , UPDI_CMD_COMPLETE         = 11
   };
 
+  #ifdef ENABLE_ADDFEATS_SWEEP
+  /* One cell of the link characterization */
+  struct sweep_cell_t {
+    uint16_t addr;        // scratch SRAM
+    uint8_t length;       // block length
+    uint8_t rounds;       // 0 only restores the link
+    uint8_t clksel;       // UPDICLKSEL under test
+    uint8_t gtval;        // GTVAL under test
+    uint8_t clksel_orig;  // 0xFF until read from the target
+    bool lost;            // the previous cell lost the link
+    uint16_t echo_errors;
+    uint16_t parity_errors;
+    uint16_t data_errors;
+    uint16_t ticks;
+  } extern sweep;
+  #endif
+
   #ifdef ENABLE_DEBUG_UPDI_SENDER
   extern uint16_t _send_ptr;
   void _send_buf_clear (void);
@@ -229,6 +271,8 @@ namespace UPDI {
 
   void setup (void);
   bool Target_Reset (bool _enable);
+  bool is_synchronized (void);
+  bool Target_Release (void);
   bool updi_reset (bool logic);
   void drain (void);
 
@@ -237,6 +281,7 @@ namespace UPDI {
   void BREAK (void);
   void STOP (void);
   bool send_bytes (uint8_t *_data, uint8_t _len);
+  bool set_pointer (uint32_t addr);
   bool send_repeat_header (uint32_t addr, uint8_t cmd, uint8_t len);
   bool st8 (uint32_t addr, uint8_t data);
   bool sts8 (uint32_t addr, uint8_t *data, uint8_t len);
@@ -246,6 +291,9 @@ namespace UPDI {
   uint8_t ld8 (uint32_t addr);
   bool lds8 (uint32_t addr, uint8_t *data, uint8_t len);
   bool lds16 (uint32_t addr, uint8_t *data, size_t len);
+  #ifdef ENABLE_ADDFEATS_PREFETCH
+  bool lds_idle (uint32_t addr, uint8_t *data, size_t len, void (*idle)(void));
+  #endif
 
   uint8_t get_cs_stat (uint8_t code);
   bool is_cs_stat (uint8_t code, uint8_t check);
@@ -270,7 +318,15 @@ namespace UPDI {
   bool chip_erase (void);
   bool enter_updi (bool skip = false);
   bool enter_prog (void);
+  #if defined(ENABLE_ADDFEATS_MAILBOX) || defined(ENABLE_ADDFEATS_WAIT)
+  bool attach (void);
+  #endif
   bool updi_activate (bool hv_active);
+  #ifdef ENABLE_ADDFEATS_SWEEP
+  uint16_t sweep_divisor (uint8_t clksel);
+  bool sweep_run (void);
+  #endif
+  uint16_t deadline (uint8_t updi_cmd);
   bool runtime (uint8_t updi_cmd);
 } // end of UPDI
 
@@ -396,8 +452,22 @@ namespace NVM {
     , BASE45_USERROW = 0x1200
   };
   bool chip_erase (void);
+  #ifdef ENABLE_ADDFEATS_REGION_ERASE
+  bool region_erase (void);
+  #endif
   bool read_memory (uint32_t start_addr, size_t byte_count);
   bool write_memory (void);
+  #ifdef ENABLE_ADDFEATS_WRITE_BEHIND
+  extern bool write_pending;
+  extern bool write_error;
+  bool write_complete (void);
+  #endif
+  #ifdef ENABLE_ADDFEATS_PREFETCH
+  extern bool prefetch_ahead;
+  extern size_t prefetch_size;
+  void prefetch_drop (void);
+  bool prefetch_run (void);
+  #endif
 } // end of NVM
 
 namespace JTAG2 {
@@ -429,6 +499,14 @@ namespace JTAG2 {
     , CMND_SET_XMEGA_PARAMS     = 0x36 /* Undocumented, upper FW 7.xx */
     /*** ATMEL defines more than ***/
     , CMND_SET_UPDI_PARAMS      = 0x55
+    , CMND_WATCH_MEMORY         = 0x60
+    , CMND_MAILBOX              = 0x61
+    , CMND_WAIT_MEMORY          = 0x62
+    , CMND_SERIALIZE            = 0x63
+    , CMND_FILL_MEMORY          = 0x64
+    , CMND_STREAM_MEMORY        = 0x65
+    , CMND_LOOPBACK             = 0x66
+    , CMND_UPDI_SWEEP           = 0x67
   };
 
   /* Slave Response IDs */
@@ -454,6 +532,13 @@ namespace JTAG2 {
     /*** ATMEL defines more than ***/
   };
 
+  /* Event IDs (always sequence number 0xFFFF) */
+  enum jtag_event_e {
+    /*** ATMEL defines more than ***/
+      EVT_WATCH_MEMORY          = 0xD0
+    , EVT_MAILBOX               = 0xD1
+  };
+
   /*** CMND_{READ,WRITE}_MEMORY sub-command ***/
   enum jtag_mem_type_e {
     /************* Absolute Address Type = A for all *****/
@@ -484,8 +569,8 @@ namespace JTAG2 {
   /* CMND_XMEGA_ERASE sub-command */
   enum jtag_erase_mode_e {
       XMEGA_ERASE_CHIP          = 0x00
-    /* The following is not implemented */
-    /* In interactive mode, normal memory writing is substituted */
+    /* The following is implemented by ENABLE_ADDFEATS_REGION_ERASE */
+    /* Otherwise normal memory writing is substituted */
     , XMEGA_ERASE_APP           = 0x01
     , XMEGA_ERASE_BOOT          = 0x02
     , XMEGA_ERASE_EEPROM        = 0x03
@@ -565,6 +650,23 @@ namespace JTAG2 {
     , BAUD_UPPER = BAUD_115200
 #endif
 
+#ifdef ENABLE_CLOCK_SCALING
+#if (F_CPU * 2 / 2400 < 4096)
+    , BAUD_LOWER_SCALED = BAUD_2400
+#elif (F_CPU * 2 / 4800 < 4096)
+    , BAUD_LOWER_SCALED = BAUD_4800
+#elif (F_CPU * 2 / 9600 < 4096)
+    , BAUD_LOWER_SCALED = BAUD_9600
+#else
+    , BAUD_LOWER_SCALED = BAUD_19200
+#endif
+#if (F_CPU * 2 >= 24000000UL)
+    , BAUD_UPPER_SCALED = BAUD_3000000
+#else
+    , BAUD_UPPER_SCALED = BAUD_2000000
+#endif
+#endif
+
   };
 
   /*** AVR_EB BOOTROW Support (FWV=6 and 7) ****************/
@@ -641,6 +743,7 @@ namespace JTAG2 {
   enum jtag_packet_e {
       MESSAGE_START = 0x1B          /* SOH */
     , TOKEN         = 0x0E          /* STX */
+    , STREAM_MARK   = 0x06          /* ACK */
     , MAX_BODY_SIZE = 10 + 512 + 10
     , BUFFER_CACHE  = 10 + 256 + 10
     , MESSAGE_ID    = 0
@@ -649,6 +752,7 @@ namespace JTAG2 {
     , DATA_LENGTH   = 2
     , DATA_ADDRESS  = 6
     , DATA_START    = 10
+    , ERASE_ADDRESS = 2
   };
   union jtag_packet_t {
     uint8_t _pad;                   // alignment padding
@@ -673,7 +777,56 @@ namespace JTAG2 {
   /* pblic methods */
   void setup (void);
   void set_response (jtag_response_e response_code);
+  void answer_transfer (void);
+  #ifdef ENABLE_ADDFEATS_PREFETCH
+  void answer_begin (void);
+  void answer_step (void);
+  void answer_rest (void);
+  #endif
   void wakeup_jtag (void);
+  #ifdef ENABLE_ADDFEATS_STREAM
+  uint8_t put (uint8_t _data);
+  void flush (void);
+  uint16_t crc16_update (uint16_t _crc, uint8_t _data);
+  #endif
+  #if defined(ENABLE_ADDFEATS_STREAM) || defined(ENABLE_ADDFEATS_SERIAL)
+  uint16_t write_unit (uint8_t mem_type, uint32_t addr, uint32_t count);
+  uint16_t piece_length (uint16_t unit, uint32_t addr, uint32_t count);
+  bool write_piece (uint8_t mem_type, uint32_t addr, uint16_t len);
+  #endif
 } // end of JTAG2
 
+namespace MON {
+  #if defined(ENABLE_ADDFEATS_WATCH) || defined(ENABLE_ADDFEATS_MAILBOX)
+  void stream_loop (uint8_t updi_cmd, uint8_t event_id, uint16_t period);
+  #endif
+  #ifdef ENABLE_ADDFEATS_WATCH
+  bool watch_setup (void);
+  bool watch_sample (void);
+  void watch_loop (void);
+  #endif
+  #ifdef ENABLE_ADDFEATS_MAILBOX
+  bool mailbox_setup (void);
+  bool mailbox_drain (void);
+  void mailbox_loop (void);
+  #endif
+  #ifdef ENABLE_ADDFEATS_WAIT
+  bool wait_poll (void);
+  void wait_memory (void);
+  #endif
+} // end of MON
+
+namespace SER {
+  #ifdef ENABLE_ADDFEATS_SERIAL
+  bool command (void);
+  #endif
+} // end of SER
+
+namespace BLK {
+  #ifdef ENABLE_ADDFEATS_STREAM
+  bool stream_setup (void);
+  void stream (void);
+  #endif
+} // end of BLK
+
 // end of header
@@ -0,0 +1,118 @@
+/**
+ * @file SER.cpp
+ * @author askn (K.Sato) multix.jp
+ * @brief
+ * @version 0.1
+ * @date 2023-12-24
+ *
+ * @copyright Copyright (c) 2023 askn37 at github.com
+ *
+ */
+#include "Prototypes.h"
+#include <avr/eeprom.h>
+#include <api/capsule.h>
+
+#ifdef ENABLE_ADDFEATS_SERIAL
+
+namespace SER {
+  /* Serialization template kept in the programmer's own EEPROM */
+  struct serial_template_t {
+    uint8_t mem_type;               // JTAG2 memory type
+    uint8_t length;                 // record length
+    uint8_t offset;                 // counter offset in record
+    uint8_t width;                  // counter width (1 to 4)
+    uint32_t addr;                  // target address
+    uint32_t increment;             // added after each write
+    uint32_t counter;               // next value to write
+    uint8_t record[SERIAL_RECORD];  // record image
+  } EEMEM serial_template;
+}
+
+/*
+ * CMND_SERIALIZE
+ *   body[1]   : 0 = write the next record, 1 = set template, 2 = get template
+ *
+ * Set template (get template answers RSP_MEMORY in the same layout)
+ *   body[2]   : memory type (MTYPE_XMEGA_EEPROM, MTYPE_XMEGA_USERSIG, ...)
+ *   body[3]   : record length (1 to SERIAL_RECORD)
+ *   body[4]   : counter offset in record
+ *   body[5]   : counter width (1 to 4, little endian)
+ *   body[6..9]   : target address
+ *   body[10..13] : increment
+ *   body[14..17] : next counter value
+ *   body[18..]   : record image (calibration constants etc.)
+ *
+ * The record is written in the pieces JTAG2::write_unit() allows.
+ * A template that the connected target cannot take is refused here.
+ *
+ * Write the next record answers RSP_MEMORY
+ *   body[1..4] : counter value written
+ *
+ * Returns true when the request must not be repeated on retransmission.
+ */
+
+bool SER::command (void) {
+  uint8_t *p = &JTAG2::packet.body[2];
+  uint8_t *e = (uint8_t*)&serial_template;
+  switch (JTAG2::packet.body[1]) {
+    case 0 : break;
+    case 1 : {
+      uint8_t _length = p[1];
+      if (_length == 0 || _length > SERIAL_RECORD
+       || p[3] == 0 || p[3] > 4 || p[2] + p[3] > _length
+       || JTAG2::packet.size_word[0] != 18 + _length) {
+        JTAG2::set_response(JTAG2::RSP_ILLEGAL_VALUE);
+        return false;
+      }
+      /* Refused now if the connected NVMCTRL cannot write it */
+      if (bit_is_set(UPDI_CONTROL, UPDI::UPDI_INFO_bp)
+       && !JTAG2::write_unit(p[0], _CAPS32(p[4])->dword, _length)) return false;
+      /* Only the changed bytes are rewritten */
+      eeprom_update_block(p, e, 16 + _length);
+      return true;
+    }
+    case 2 : {
+      eeprom_read_block(p, e, sizeof(serial_template));
+      JTAG2::packet.body[JTAG2::MESSAGE_ID] = JTAG2::RSP_MEMORY;
+      JTAG2::packet.size_word[0] = 2 + sizeof(serial_template);
+      return false;
+    }
+    default : {
+      JTAG2::set_response(JTAG2::RSP_ILLEGAL_PARAMETER);
+      return false;
+    }
+  }
+
+  /* Build a CMND_WRITE_MEMORY packet from the template */
+  serial_template_t _tmpl;
+  eeprom_read_block(&_tmpl, e, sizeof(serial_template));
+  if (_tmpl.length == 0 || _tmpl.length > SERIAL_RECORD) {
+    JTAG2::set_response(JTAG2::RSP_ILLEGAL_MCU_STATE);
+    return false;
+  }
+  uint8_t *c = (uint8_t*)&_tmpl.counter;
+  for (uint8_t i = 0; i < _tmpl.width; i++) _tmpl.record[_tmpl.offset + i] = c[i];
+  uint16_t _unit = JTAG2::write_unit(_tmpl.mem_type, _tmpl.addr, _tmpl.length);
+  if (!_unit) return false;
+
+  uint8_t _done = 0;
+  do {
+    uint32_t _addr = _tmpl.addr + _done;
+    uint16_t _len = JTAG2::piece_length(_unit, _addr, _tmpl.length - _done);
+    uint8_t *q = &JTAG2::packet.body[JTAG2::DATA_START];
+    for (uint8_t i = 0; i < _len; i++) q[i] = _tmpl.record[_done + i];
+    if (!JTAG2::write_piece(_tmpl.mem_type, _addr, _len)) return false;
+    _done += _len;
+  } while (_done < _tmpl.length);
+
+  /* The counter advances only after a successful write */
+  eeprom_update_dword(&serial_template.counter, _tmpl.counter + _tmpl.increment);
+  JTAG2::packet.body[JTAG2::MESSAGE_ID] = JTAG2::RSP_MEMORY;
+  _CAPS32(JTAG2::packet.body[1])->dword = _tmpl.counter;
+  JTAG2::packet.size_word[0] = 5;
+  return true;
+}
+
+#endif
+
+// end of code
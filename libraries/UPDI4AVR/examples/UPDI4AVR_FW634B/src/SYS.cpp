@@ -11,6 +11,16 @@
 #include "Prototypes.h"
 #include <avr/io.h>
 
+namespace SYS {
+  /* Set by the RTS interrupt until a JTAG host shows up */
+  volatile bool handover_wait = false;
+  volatile uint16_t handover_stamp;
+  #ifdef ENABLE_CLOCK_SCALING
+  /* 1 while the CPU runs at F_CPU * 2 */
+  uint8_t clock_shift = 0;
+  #endif
+}
+
 void SYS::setup (void) {
 
   /* Target reset release */
@@ -59,6 +69,15 @@ void SYS::setup (void) {
   /* Initialize state variables */
   UPDI_CONTROL = 0;
   UPDI_NVMCTRL = 0;
+
+  #ifdef ENABLE_CLOCK_SCALING
+  /* Drop the main clock prescaler only when VDD allows full speed */
+  /* Every divisor that depends on F_CPU is derived afterwards     */
+  if (F_CPU * 2 <= 20000000UL && get_vcc() >= CLOCK_SCALING_MV) {
+    _PROTECTED_WRITE(CLKCTRL_MCLKCTRLB, 0);
+    clock_shift = 1;
+  }
+  #endif
 }
 
 /************************
@@ -68,8 +87,8 @@ void SYS::setup (void) {
 /*** This routine is exclusive to the tinyAVR-2 series. ***/
 uint16_t SYS::get_vcc (void) {
   ADC0_CTRLA = ADC_ENABLE_bm;
-  ADC0_CTRLB = ADC_PRESC_DIV2_gc;
-  ADC0_CTRLC = ADC_REFSEL_1024MV_gc | ((F_CPU / 1000000UL) << ADC_TIMEBASE_gp);
+  ADC0_CTRLB = ADC_PRESC_DIV2_gc + clock_shift; /* DIV4 at F_CPU * 2 */
+  ADC0_CTRLC = ADC_REFSEL_1024MV_gc | (((F_CPU / 1000000UL) << clock_shift) << ADC_TIMEBASE_gp);
   ADC0_CTRLE = 17; /* (SAMPDUR + 0.5) * fCLK_ADC = 10.5 µs sample duration */
   ADC0_MUXPOS = ADC_MUXPOS_VDDDIV10_gc; /* ADC channel VDD/10 */
   ADC0_COMMAND = ADC_MODE_SINGLE_12BIT_gc | ADC_START_IMMEDIATE_gc;
@@ -112,6 +131,50 @@ void SYS::LED_Invert (void) {
   pinControlRegister(LEDG_PIN) = PORT_INVEN_bm | PORT_ISC_INPUT_DISABLE_gc;
 }
 
+/****************************
+ * RTS pass-through control *
+ ****************************/
+
+/* Called from the RTS interrupt while the UART is held */
+void SYS::Handover_Start (void) {
+  handover_stamp = TIM::Ticks();
+  handover_wait = true;
+}
+
+/* A JTAG host has started, so the UART is kept */
+void SYS::Handover_Cancel (void) {
+  handover_wait = false;
+}
+
+bool SYS::Handover_Pending (void) {
+  return handover_wait;
+}
+
+bool SYS::Handover_Expired (void) {
+  return handover_wait
+    && (uint16_t)(TIM::Ticks() - handover_stamp) >= RTS_HANDOVER_TICKS;
+}
+
+/* The UART goes back to the target without a system reboot */
+void SYS::Handover (void) {
+  handover_wait = false;
+  WDT_OFF();
+  openDrainWrite(TRST_PIN, HIGH);
+  UPDI::Target_Reset(false);
+  PG_Disable();
+  portRegister(RTS_SENSE_PIN).INTFLAGS =
+  portRegister(RTS_SENSE_PIN).INTFLAGS;
+  RTS_Enable();
+
+  /* Keeps the LED flashing while the serial console is open. */
+  /* Closing it is the next RTS edge.                          */
+  if (!digitalRead(RTS_SENSE_PIN)) {
+    TIM::LED_Flash();
+    while (!handover_wait && !digitalRead(RTS_SENSE_PIN));
+  }
+  if (!handover_wait) TIM::LED_HeartBeat();
+}
+
 /***************************************
  * Run at the end of the boot sequence *
  ***************************************/
@@ -21,6 +21,7 @@
  *   TCB0 -- For Timeout generation   CLK_TCB0 := PIT/128 (EVSYS_CH1)
  *           For Baudrate calibratoer CLK_TCB0 := F_CPU
  *   TCB1 -- LED Control              CLK_TCB1 := CLK_PER
+ *   RTC  -- Free running time stamp  CLK_RTC  := OSC32K/32 (1.024kHz)
  *
  * [LED control]
  *   Division ratio is based on F_CPU := 10MHz/20MHz
@@ -83,12 +84,15 @@ void TIM::setup (void) {
   /* RTC_PIT enable */
   RTC_PITCTRLA = RTC_PITEN_bm;
 
+  /* RTC_CNT free running : 1 tick is 1/1024 sec */
+  RTC_CTRLA = RTC_PRESCALER_DIV32_gc | RTC_RUNSTDBY_bm | RTC_RTCEN_bm;
+
   /* Timer */
 
   /* TCA0 */
   TCA0_SPLIT_CTRLD = TCA_SPLIT_SPLITM_bm;
-  TCA0_SPLIT_LPER  = TCA0_STEP - 2;
-  TCA0_SPLIT_LCMP0 = TCA0_STEP / 2;
+  TCA0_SPLIT_LPER  = HBEAT_STEP - 2;
+  TCA0_SPLIT_LCMP0 = HBEAT_STEP / 2;
   TCA0_SPLIT_HPER  = 1;
   TCA0_SPLIT_HCMP0 = 1;     /* WOA3=PA3 */
   TCA0_SPLIT_HCMP1 = 1;     /* WOA4=PA4 */
@@ -120,6 +124,18 @@ void TIM::Timeout_Stop (void) {
   reti();
 }
 
+/*
+ * Time stamp (1.024kHz, wraps every 64 seconds)
+ */
+
+uint16_t TIM::Ticks (void) {
+  uint16_t _ticks;
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    _ticks = RTC_CNT;
+  }
+  return _ticks;
+}
+
 /*
  * LED operation switching
  */
@@ -128,7 +144,7 @@ void TIM::Timeout_Stop (void) {
 void TIM::LED_HeartBeat (void) {
   if (TIM::mode != 1) {
     TIM::mode = 1;
-    TCB1_CCMP = TCB1_HBEAT;
+    TCB1_CCMP = HBEAT_CCMP;
     TCB1_CNT = 0;
     TCB1_CTRLA = TCB_RUNSTDBY_bm | TCB_ENABLE_bm | TCB_CLKSEL_TCA0_gc;
     LEDG_EVOUT = EVSYS_USER_CHANNEL2_gc;
@@ -165,7 +181,9 @@ void TIM::LED_Fast (void) {
 void TIM::LED_Stop (void) {
   if (TIM::mode != 0) {
     TIM::mode = 0;
-    TCA0_SPLIT_CTRLA = TCA_SPLIT_RUNSTDBY_bm | TCA_SPLIT_ENABLE_bm | TCA_SPLIT_CLKSEL_DIV1_gc;
+    /* The pump runs at the same rate on the scaled clock */
+    TCA0_SPLIT_CTRLA = TCA_SPLIT_RUNSTDBY_bm | TCA_SPLIT_ENABLE_bm
+                     | (SYS::clock_shift ? TCA_SPLIT_CLKSEL_DIV2_gc : TCA_SPLIT_CLKSEL_DIV1_gc);
     LEDG_EVOUT = EVSYS_USER_OFF_gc;
     digitalWrite(LEDG_PIN, LOW);
   }
@@ -187,16 +205,21 @@ void TIM::HV_Pulse_OFF (void) {
  * Constant delay
  */
 
+/* The cycle counts are for F_CPU, so they are repeated on the scaled clock */
+
 void TIM::delay_50us (void) {
-  delay_micros(50);
+  uint8_t i = SYS::clock_shift;
+  do delay_micros(50); while (i--);
 }
 
 void TIM::delay_800us (void) {
-  delay_micros(800);
+  uint8_t i = SYS::clock_shift;
+  do delay_micros(800); while (i--);
 }
 
 void TIM::delay_200ms (void) {
-  delay_millis(200);
+  uint8_t i = SYS::clock_shift;
+  do delay_millis(200); while (i--);
 }
 
 /*
@@ -227,7 +250,7 @@ ISR(portIntrruptVector(SW_SENSE_PIN), ISR_NAKED) {
 
   /* Attempt to reset the target hardware. */
   UPDI_USART.CTRLB = UPDI_USART_OFF;
-  delay_micros(800);
+  TIM::delay_800us();
   pinMode(UPDI_TDAT_PIN, OUTPUT);
   digitalWrite(UPDI_TDAT_PIN, LOW);
   openDrainWrite(TRST_PIN, LOW);
@@ -247,14 +270,16 @@ ISR(portIntrruptVector(SW_SENSE_PIN), ISR_NAKED) {
 
 ISR(portIntrruptVector(RTS_SENSE_PIN)) {
   /***
-    When this interrupt occurs, the WDT is reconfigured and the target
-    device is held in reset. If JTAG communication is not started within
-    the timeout limit, the system will be reset. Typically this is the
-    signal that starts the Arduino bootloader. Therefore, the time limit
-    is set to approximately 250ms.
+    When this interrupt occurs, the target device is held in reset and
+    the UART is taken for JTAG. If MESSAGE_START does not arrive within
+    RTS_HANDOVER_TICKS, or any other byte arrives first, the UART is handed
+    back to the target without a reboot. Typically this is the signal
+    that starts the Arduino bootloader. The WDT only guards a JTAG host
+    that stops halfway.
   ***/
 
-  SYS::WDT_Short();
+  SYS::WDT_ON();
+  SYS::Handover_Start();
   SYS::RTS_Disable();
   portRegister(RTS_SENSE_PIN).INTFLAGS =
   portRegister(RTS_SENSE_PIN).INTFLAGS;
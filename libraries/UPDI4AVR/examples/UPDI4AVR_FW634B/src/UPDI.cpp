@@ -22,6 +22,13 @@
 /* BREAK length during HV control (10MHz=712?) */
 #define UPDI_BAUD_SHORT_BREAK (F_CPU / 10000)
 
+/* The divisors follow the CPU clock chosen at boot */
+#define UPDI_BAUD_RUN   ((uint16_t)UPDI_BAUD_CALC << SYS::clock_shift)
+#define UPDI_BAUD_LONG  ((uint16_t)UPDI_BAUD_BREAK << SYS::clock_shift)
+#if defined(ENABLE_CLOCK_SCALING) && ((UPDI_BAUD_BREAK * 2) > 65535)
+#error "UPDI BREAK divisor does not fit at the scaled clock"
+#endif
+
 namespace UPDI {
   static uint8_t nvmprog_key[10] =    /* "NVMProg " */
     {UPDI_SYNCH, UPDI_KEY_64, 0x20, 0x67, 0x6F, 0x72, 0x50, 0x4D, 0x56, 0x4E};
@@ -36,6 +43,20 @@ namespace UPDI {
     , 0, 0, 0, 0    // 24bit address
   };
 
+  /* Where the target's pointer register was left, -1 is unknown */
+  static uint32_t _ptr_shadow = -1;
+
+  /* NVMCTRL version 0 (tinyAVR and megaAVR) has a 16-bit pointer */
+  inline bool is_ptr_wide (uint32_t addr) {
+    return (addr >> 16) || (UPDI_NVMCTRL & (
+      _BV(UPDI_GEN2_bp) | _BV(UPDI_GEN3_bp) | _BV(UPDI_GEN4_bp) | _BV(UPDI_GEN5_bp)));
+  }
+
+  /* Direct addressing is 16-bit whenever the address fits */
+  inline uint8_t addr_width (uint32_t addr) {
+    return (addr >> 16) ? UPDI_ADDR3 : UPDI_ADDR2;
+  }
+
   static uint8_t _set_repeat[] = {
       UPDI_SYNCH
     , UPDI_REPEAT | UPDI_DATA1
@@ -67,7 +88,7 @@ namespace UPDI {
 }
 
 void UPDI::setup (void) {
-  UPDI_USART.BAUD  = UPDI_BAUD_CALC;
+  UPDI_USART.BAUD  = UPDI_BAUD_RUN;
   UPDI_USART.CTRLA = UPDI_USART_CTRLA;
   UPDI_USART.CTRLC = UPDI_USART_CTRLC;
   UPDI_USART.CTRLB = UPDI_USART_ON;
@@ -100,8 +121,45 @@ bool UPDI::Target_Reset (bool _enable) {
     return send_bytes(set_ptr_off, sizeof(set_ptr_off));
 }
 
+/* A running session answers STATUSA within a few bit times */
+bool UPDI::is_synchronized (void) {
+  static uint8_t set_ptr[] = { UPDI_SYNCH, UPDI_LDCS | UPDI_CS_STATUSA };
+  if (bit_is_clear(UPDI_CONTROL, UPDI_INFO_bp) || UPDI_LASTH) return false;
+  if (!send_bytes(set_ptr, sizeof(set_ptr))) return false;
+  uint16_t _stamp = TIM::Ticks();
+  while (bit_is_clear(UPDI_USART.STATUS, USART_RXCIF_bp)) {
+    if ((uint16_t)(TIM::Ticks() - _stamp) > 2) return false;
+  }
+  /* UPDIREV is never zero */
+  return (RECV() & 0xF0) && UPDI_LASTH == 0;
+}
+
+/* Releases the target through the running session without BREAK */
+/* Only a lost link falls back to the full Target_Reset sequence */
+bool UPDI::Target_Release (void) {
+  static uint8_t set_ptr_go[] = {
+      UPDI_SYNCH
+    , UPDI_STCS | UPDI_CS_ASI_RESET_REQ
+    , UPDI_RSTREQ
+    , UPDI_SYNCH
+    , UPDI_STCS | UPDI_CS_ASI_RESET_REQ
+    , UPDI_NOP
+    , UPDI_SYNCH
+    , UPDI_STCS | UPDI_CS_CTRLB
+    , UPDI_SET_UPDIDIS
+  };
+  if (!digitalRead(UPDI_TDAT_PIN)) return false;
+  if (!is_synchronized()) {
+    drain();
+    return Target_Reset(true) && Target_Reset(false);
+  }
+  _ptr_shadow = -1;
+  return send_bytes(set_ptr_go, sizeof(set_ptr_go));
+}
+
 /* This only does a system reset */
 bool UPDI::updi_reset (bool logic) {
+  _ptr_shadow = -1;
   return set_cs_stat(
     UPDI_CS_ASI_RESET_REQ,
     (logic ? UPDI_RSTREQ : UPDI_NOP));
@@ -113,6 +171,8 @@ bool UPDI::updi_reset (bool logic) {
 
 void UPDI::drain (void) {
   uint8_t j = 0;
+  /* Whatever was interrupted, the pointer is no longer known */
+  _ptr_shadow = -1;
   do {
     if (bit_is_set(UPDI_USART.STATUS, USART_RXCIF_bp)) {
       UPDI_LASTH = UPDI_USART.RXDATAH ^ 0x80;
@@ -155,11 +215,12 @@ bool UPDI::SEND (uint8_t _data) {
 /* BREAK character : Generated by slowing down the sending speed */
 void UPDI::BREAK (void) {
   loop_until_bit_is_set(UPDI_USART.STATUS, USART_DREIF_bp);
-  UPDI_USART.BAUD = UPDI_BAUD_BREAK;
+  UPDI_USART.BAUD = UPDI_BAUD_LONG;
   /* Maintains low level signal at least 768bit long */
   SEND(UPDI_NOP);
-  UPDI_USART.BAUD = UPDI_BAUD_CALC;
+  UPDI_USART.BAUD = UPDI_BAUD_RUN;
   bit_clear(UPDI_CONTROL, UPDI_CLKU_bp);
+  _ptr_shadow = -1;
 }
 
 /* Required if repeat transmission fails */
@@ -187,14 +248,31 @@ bool UPDI::send_bytes (uint8_t *data, uint8_t len) {
  * Repeat header transmission
  */
 
+/* A sequential access continues from the pointer left by the last one */
+bool UPDI::set_pointer (uint32_t addr) {
+  if (addr == _ptr_shadow) return true;
+  _ptr_shadow = -1;
+  _CAPS32(_set_ptr_l[2])->dword = addr;
+  if (is_ptr_wide(addr)) {
+    _set_ptr_l[1] = UPDI_ST | UPDI_PTR_REG | UPDI_DATA3;
+    if (!send_bytes(_set_ptr_l, sizeof(_set_ptr_l) - 1)) return false;
+  }
+  else {
+    _set_ptr_l[1] = UPDI_ST | UPDI_PTR_REG | UPDI_DATA2;
+    if (!send_bytes(_set_ptr_l, sizeof(_set_ptr_l) - 2)) return false;
+  }
+  return UPDI_ACK == RECV();
+}
+
 /* __attribute__((optimize("O0"))) */
 bool UPDI::send_repeat_header (uint32_t addr, uint8_t cmd, uint8_t len) {
-  _CAPS32(_set_ptr_l[2])->dword = addr;
+  if (!set_pointer(addr)) return false;
   _set_repeat[2] = len - 1;
   _set_repeat[4] = UPDI_PTR_INC | cmd;  // ST,LD + DATA1,DATA2
-  if (!send_bytes(_set_ptr_l, sizeof(_set_ptr_l) - 1)) return false;
-  if (UPDI_ACK != RECV()) return false;
-  return send_bytes(_set_repeat, sizeof(_set_repeat));
+  if (!send_bytes(_set_repeat, sizeof(_set_repeat))) return false;
+  /* Valid only until the transfer fails, a count of 0 is 256 */
+  _ptr_shadow = addr + ((uint16_t)(len ? len : 256) << (cmd & UPDI_DATA2));
+  return true;
 }
 
 /*
@@ -207,8 +285,10 @@ bool UPDI::st8 (uint32_t addr, uint8_t data) {
     , UPDI_STS | UPDI_ADDR3 | UPDI_DATA1
     , 0, 0, 0, 0    // 24bit address
   };
+  uint8_t _width = addr_width(addr);
+  set_ptr[1] = UPDI_STS | _width | UPDI_DATA1;
   _CAPS32(set_ptr[2])->dword = addr;
-  if (!send_bytes(set_ptr, sizeof(set_ptr) - 1)) return false;
+  if (!send_bytes(set_ptr, _width == UPDI_ADDR3 ? 5 : 4)) return false;
   if (UPDI_ACK != RECV()) return false;
   if (!SEND(data)) return false;
   return UPDI_ACK == RECV();
@@ -225,6 +305,7 @@ bool UPDI::sts8 (uint32_t addr, uint8_t *data, uint8_t len) {
       if (UPDI_ACK != RECV()) break;
     } while (--len);
   }
+  if (len) _ptr_shadow = -1;
   return len == 0;
 }
 
@@ -238,15 +319,16 @@ bool UPDI::sts16 (uint32_t addr, uint8_t *data, size_t len) {
       if (UPDI_ACK != RECV()) break;
     } while (--repeat);
   }
-  return len == 0;
+  if (repeat) _ptr_shadow = -1;
+  return repeat == 0;
 }
 
 bool UPDI::sts8rsd (uint32_t addr, uint8_t *data, uint8_t len) {
-  _CAPS32(_set_ptr_l[2])->dword = addr;
+  if (!set_pointer(addr)) return false;
+  /* Without ACK the final pointer cannot be confirmed */
+  _ptr_shadow = -1;
   _set_repeat[2] = len - 1;
   _set_repeat[4] = UPDI_PTR_INC|UPDI_ST|UPDI_DATA1;
-  if (!send_bytes(_set_ptr_l, sizeof(_set_ptr_l) - 1)) return false;
-  if (UPDI_ACK != RECV()) return false;
   if (!set_cs_ctra(UPDI_GTVAL_RSD)) return false;
   if (!send_bytes(_set_repeat, sizeof(_set_repeat))) return false;
   do {              /* Repeat byte send */
@@ -257,12 +339,12 @@ bool UPDI::sts8rsd (uint32_t addr, uint8_t *data, uint8_t len) {
 }
 
 bool UPDI::sts16rsd (uint32_t addr, uint8_t *data, size_t len) {
-  _CAPS32(_set_ptr_l[2])->dword = addr;
+  if (!set_pointer(addr)) return false;
+  /* Without ACK the final pointer cannot be confirmed */
+  _ptr_shadow = -1;
   uint8_t repeat = len >> 1;
   _set_repeat[2] = repeat - 1;
   _set_repeat[4] = UPDI_PTR_INC|UPDI_ST|UPDI_DATA2;
-  if (!send_bytes(_set_ptr_l, sizeof(_set_ptr_l) - 1)) return false;
-  if (UPDI_ACK != RECV()) return false;
   if (!set_cs_ctra(UPDI_GTVAL_RSD)) return false;
   if (!send_bytes(_set_repeat, sizeof(_set_repeat))) return false;
   do {              /* Repeat word send */
@@ -283,14 +365,17 @@ uint8_t UPDI::ld8 (uint32_t addr) {
     , UPDI_LDS|UPDI_ADDR3|UPDI_DATA1
     , 0, 0, 0, 0  // 24bit address
   };
-  _CAPS16(set_ptr[2])->word = (uint16_t)addr;
-  while (!send_bytes(set_ptr, sizeof(set_ptr) - 1)) BREAK();
+  uint8_t _width = addr_width(addr);
+  set_ptr[1] = UPDI_LDS | _width | UPDI_DATA1;
+  _CAPS32(set_ptr[2])->dword = addr;
+  while (!send_bytes(set_ptr, _width == UPDI_ADDR3 ? 5 : 4)) BREAK();
   return RECV();
 }
 
 bool UPDI::lds8 (uint32_t addr, uint8_t *data, uint8_t len) {
   if (!send_repeat_header(addr, UPDI_LD|UPDI_DATA1, len)) return false;
   do { *data++ = RECV(); } while (--len);
+  if (UPDI_LASTH) _ptr_shadow = -1;
   return UPDI_LASTH == 0;
 }
 
@@ -301,9 +386,30 @@ bool UPDI::lds16 (uint32_t addr, uint8_t *data, size_t len) {
     *data++ = RECV();
     *data++ = RECV();
   } while (--repeat);
+  if (UPDI_LASTH) _ptr_shadow = -1;
   return UPDI_LASTH == 0;
 }
 
+#ifdef ENABLE_ADDFEATS_PREFETCH
+/* The same as lds8/lds16, calling idle() while each byte is on the wire */
+bool UPDI::lds_idle (uint32_t addr, uint8_t *data, size_t len, void (*idle)(void)) {
+  if ((len - 1) >> 8) {
+    /* 512 bytes are 256 words, a count of 0 that the shadow follows */
+    if (!send_repeat_header(addr, UPDI_LD|UPDI_DATA2, (uint8_t)(len >> 1))) return false;
+  }
+  else if (!send_repeat_header(addr, UPDI_LD|UPDI_DATA1, len)) return false;
+  do {
+    while (bit_is_clear(UPDI_USART.STATUS, USART_RXCIF_bp)) idle();
+    *data++ = RECV();
+    if (UPDI_LASTH) {
+      _ptr_shadow = -1;
+      return false;
+    }
+  } while (--len);
+  return true;
+}
+#endif
+
 /*
  * Control status reception
  */
@@ -354,18 +460,24 @@ uint8_t UPDI::get_cs_asi_ctra (void) {
   return get_cs_stat(UPDI_CS_ASI_CTRLA);
 }
 
+/*
+ * Status polling : limit is in RTC ticks (1/1024 sec)
+ *                  0 waits until the runtime deadline
+ */
+
 /* __attribute__((optimize("O0"))) */
 bool UPDI::loop_until_sys_stat_is_clear (uint8_t bitmap, uint16_t limit) {
   #ifdef ENABLE_DEBUG_UPDI_SENDER
   uint16_t _back = _send_ptr;
   #endif
+  uint16_t _start = TIM::Ticks();
   do {
     if (!is_sys_stat(bitmap)) return true;
     #ifdef ENABLE_DEBUG_UPDI_SENDER
     _send_ptr = _back;
     #endif
     TIM::delay_50us();
-  } while (--limit);
+  } while (!limit || (uint16_t)(TIM::Ticks() - _start) < limit);
   return false;
 }
 
@@ -374,13 +486,14 @@ bool UPDI::loop_until_sys_stat_is_set (uint8_t bitmap, uint16_t limit) {
   #ifdef ENABLE_DEBUG_UPDI_SENDER
   uint16_t _back = _send_ptr;
   #endif
+  uint16_t _start = TIM::Ticks();
   do {
     if (is_sys_stat(bitmap)) return true;
     #ifdef ENABLE_DEBUG_UPDI_SENDER
     _send_ptr = _back;
     #endif
     TIM::delay_50us();
-  } while (--limit);
+  } while (!limit || (uint16_t)(TIM::Ticks() - _start) < limit);
   return false;
 }
 
@@ -389,13 +502,14 @@ bool UPDI::loop_until_key_stat_is_clear (uint8_t bitmap, uint16_t limit) {
   #ifdef ENABLE_DEBUG_UPDI_SENDER
   uint16_t _back = _send_ptr;
   #endif
+  uint16_t _start = TIM::Ticks();
   do {
     if (!is_key_stat(bitmap)) return true;
     #ifdef ENABLE_DEBUG_UPDI_SENDER
     _send_ptr = _back;
     #endif
     TIM::delay_50us();
-  } while (--limit);
+  } while (!limit || (uint16_t)(TIM::Ticks() - _start) < limit);
   return false;
 }
 
@@ -404,13 +518,14 @@ bool UPDI::loop_until_key_stat_is_set (uint8_t bitmap, uint16_t limit) {
   #ifdef ENABLE_DEBUG_UPDI_SENDER
   uint16_t _back = _send_ptr;
   #endif
+  uint16_t _start = TIM::Ticks();
   do {
     if (is_key_stat(bitmap)) return true;
     #ifdef ENABLE_DEBUG_UPDI_SENDER
     _send_ptr = _back;
     #endif
     TIM::delay_50us();
-  } while (--limit);
+  } while (!limit || (uint16_t)(TIM::Ticks() - _start) < limit);
   return false;
 }
 
@@ -478,12 +593,13 @@ void UPDI::HV_Pulse (void) {
 
   /* Keep the UPDI signal low for as long as necessary */
   // UPDI_USART.BAUD = UPDI_BAUD_SHORT_BREAK;
-  UPDI_USART.BAUD = UPDI_BAUD_BREAK;
+  UPDI_USART.BAUD = UPDI_BAUD_LONG;
   SEND(UPDI_NOP);
-  UPDI_USART.BAUD = UPDI_BAUD_CALC;
+  UPDI_USART.BAUD = UPDI_BAUD_RUN;
 
   bit_clear(UPDI_CONTROL, UPDI_CLKU_bp);
   bit_set(UPDI_CONTROL, UPDI_ERHV_bp);
+  _ptr_shadow = -1;
 }
 
 /*****************************************
@@ -500,7 +616,7 @@ bool UPDI::write_userrow (const uint32_t start_addr, uint8_t *data, const size_t
     return true;
   }
   drain();
-  if (!loop_until_sys_stat_is_clear(UPDI_SYS_RSTSYS, 500)) return false;
+  if (!loop_until_sys_stat_is_clear(UPDI_SYS_RSTSYS, 100)) return false;
 
   /* Send the authentication key */
   if (!set_urowwrite_key()) return false;
@@ -509,7 +625,7 @@ bool UPDI::write_userrow (const uint32_t start_addr, uint8_t *data, const size_t
   if (!updi_reset(true) || !updi_reset(false)) return false;
 
   /* Wait for system reset to finish */
-  if (!loop_until_sys_stat_is_clear(UPDI_SYS_RSTSYS, 500)) return false;
+  if (!loop_until_sys_stat_is_clear(UPDI_SYS_RSTSYS, 100)) return false;
 
   /* Make sure you are in USERROW mode */
   loop_until_sys_stat_is_set(UPDI_SYS_UROWPROG);
@@ -522,9 +638,9 @@ bool UPDI::write_userrow (const uint32_t start_addr, uint8_t *data, const size_t
   set_cs_stat(UPDI_CS_ASI_SYS_CTRLA, UPDI_SET_UROWDONE | UPDI_SET_CLKREQ);
 
   /* Wait for data to be transferred to USERROW */
-  /* AVR_Dx requires at least 100 * 50us wait loops */
+  /* AVR_Dx requires at least 5ms */
   /* AVR_Ex may not end forever, so give up midway */
-  loop_until_sys_stat_is_clear(UPDI_SYS_UROWPROG, 200);
+  loop_until_sys_stat_is_clear(UPDI_SYS_UROWPROG, 40);
   /* Ignore any errors here */
 
   /* Step completed */
@@ -560,7 +676,7 @@ bool UPDI::chip_erase (void) {
     HV_Pulse();
   }
   drain();
-  if (!loop_until_sys_stat_is_clear(UPDI_SYS_RSTSYS, 500)) return false;
+  if (!loop_until_sys_stat_is_clear(UPDI_SYS_RSTSYS, 100)) return false;
 
   /* Set the NVMPROG key. This is useful when CRCSCAN is activated. */
   if (get_cs_stat(UPDI_CS_ASI_CRC_STATUS) & UPDI_CRC_STATUS_gm) {
@@ -585,6 +701,9 @@ bool UPDI::chip_erase (void) {
 
   /* Chip erasure was successful */
   bit_set(UPDI_CONTROL, UPDI_ERFM_bp);
+  #ifdef ENABLE_ADDFEATS_WRITE_BEHIND
+  NVM::write_pending = NVM::write_error = false;
+  #endif
 
   /* Once the HV control and device is successfully unlocked, */
   /* you should be able to enter program mode. */
@@ -616,7 +735,7 @@ bool UPDI::enter_updi (bool skip) {
     /* HV control forced permission */
     if (bit_is_set(UPDI_CONTROL, UPDI_FCHV_bp)) {
       HV_Pulse();
-      if (!loop_until_sys_stat_is_clear(UPDI_SYS_RSTSYS, 500)) return false;
+      if (!loop_until_sys_stat_is_clear(UPDI_SYS_RSTSYS, 100)) return false;
       if (!set_cs_ctrb(UPDI_SET_CCDETDIS)) return false;
 
       /* send nvmprog_key */
@@ -624,7 +743,7 @@ bool UPDI::enter_updi (bool skip) {
 
       /* restart target : change mode */
       if (!updi_reset(true) || !updi_reset(false)) return false;
-      if (!loop_until_sys_stat_is_clear(UPDI_SYS_RSTSYS, 500)) return false;
+      if (!loop_until_sys_stat_is_clear(UPDI_SYS_RSTSYS, 100)) return false;
     }
     else
       BREAK();
@@ -641,7 +760,7 @@ bool UPDI::enter_updi (bool skip) {
 
     if (is_sys_stat(UPDI_SYS_RSTSYS)) {
       updi_reset(false);
-      if (!loop_until_sys_stat_is_clear(UPDI_SYS_RSTSYS, 500)) return false;
+      if (!loop_until_sys_stat_is_clear(UPDI_SYS_RSTSYS, 100)) return false;
     }
 
     /*** Get System Information Block ***/
@@ -712,11 +831,11 @@ bool UPDI::enter_updi (bool skip) {
 
 bool UPDI::enter_prog (void) {
   if (bit_is_clear(UPDI_CONTROL, UPDI_PROG_bp)) {
-    if (!loop_until_sys_stat_is_clear(UPDI_SYS_RSTSYS, 500)) return false;
+    if (!loop_until_sys_stat_is_clear(UPDI_SYS_RSTSYS, 100)) return false;
     if (!is_sys_stat(UPDI_SYS_NVMPROG)) {
       if (!set_nvmprog_key()) return false;
       if (!updi_reset(true) || !updi_reset(false)) return false;
-      if (!loop_until_sys_stat_is_clear(UPDI_SYS_RSTSYS, 500)) return false;
+      if (!loop_until_sys_stat_is_clear(UPDI_SYS_RSTSYS, 100)) return false;
       loop_until_sys_stat_is_set(UPDI_SYS_NVMPROG);
     }
     bit_set(UPDI_CONTROL, UPDI_INFO_bp);
@@ -725,6 +844,31 @@ bool UPDI::enter_prog (void) {
   return true;
 }
 
+#if defined(ENABLE_ADDFEATS_MAILBOX) || defined(ENABLE_ADDFEATS_WAIT)
+/*************************************
+ * Running target with UPDI attached *
+ *************************************/
+
+/* The target runs its application, and UPDI stays accessible. */
+/* Flash writing requires CMND_RESET again after this.         */
+
+bool UPDI::attach (void) {
+  if (bit_is_set(UPDI_CONTROL, UPDI_PROG_bp)) {
+    /* Leaving program mode restarts the target */
+    if (!set_cs_stat(UPDI_CS_ASI_KEY_STATUS, UPDI_KEY_NVMPROG)) return false;
+    if (!updi_reset(true) || !updi_reset(false)) return false;
+    bit_clear(UPDI_CONTROL, UPDI_PROG_bp);
+    bit_clear(UPDI_CONTROL, UPDI_INIT_bp);
+  }
+  else {
+    /* After sign-on or GO, the UPDI is re-enabled without a key */
+    bit_clear(UPDI_CONTROL, UPDI_INFO_bp);
+    if (!enter_updi(false)) return false;
+  }
+  return loop_until_sys_stat_is_clear(UPDI_SYS_RSTSYS, 100);
+}
+#endif
+
 /**********************
  * UPDI authorization *
  **********************/
@@ -740,7 +884,7 @@ bool UPDI::updi_activate (bool hv_active) {
       bit_set(UPDI_CONTROL, UPDI_FCHV_bp);
     }
     if (setjmp(TIM::CONTEXT) == 0) {
-      TIM::Timeout_Start(125);
+      TIM::Timeout_Start(TIMEOUT_ACTIVATE_MS);
       enter_updi(false) && enter_prog();
     }
     TIM::Timeout_Stop();
@@ -748,14 +892,183 @@ bool UPDI::updi_activate (bool hv_active) {
   return bit_is_set(UPDI_CONTROL, UPDI_PROG_bp);
 }
 
+#ifdef ENABLE_ADDFEATS_SWEEP
+
+/******************************
+ * UPDI link characterization *
+ ******************************/
+
+UPDI::sweep_cell_t UPDI::sweep;
+
+/* USART divisor for each UPDICLKSEL, 0 is out of reach at this CPU clock */
+/* 4MHz is the normal rate, and each faster clock doubles it with CLK2X   */
+uint16_t UPDI::sweep_divisor (uint8_t clksel) {
+  uint16_t _baud = UPDI_BAUD_RUN;
+  if (clksel < UPDI_SET_UPDICLKSEL_8M) _baud >>= UPDI_SET_UPDICLKSEL_8M - clksel;
+  return _baud < 64 ? 0 : _baud;
+}
+
+/* Pseudo random block : the same sequence is regenerated to verify */
+static inline uint8_t sweep_next (uint16_t &lfsr) {
+  lfsr = (lfsr >> 1) ^ (-(lfsr & 1) & 0xB400);
+  return (uint8_t)lfsr;
+}
+
+bool UPDI::sweep_run (void) {
+  uint8_t _clk = sweep.clksel;
+
+  /* Every cell starts at the normal rate */
+  UPDI_USART.BAUD = UPDI_BAUD_RUN;
+  if (sweep.lost) {
+    /* Double BREAK resets the UPDI of the target */
+    BREAK();
+    BREAK();
+    if (!set_cs_ctrb(UPDI_SET_CCDETDIS)) return false;
+    sweep.lost = false;
+  }
+  if (sweep.clksel_orig == 0xFF)
+    sweep.clksel_orig = get_cs_asi_ctra() & UPDI_SET_UPDICLKSEL_bm;
+  if (!set_cs_ctra(UPDI_GTVAL)) return false;
+  if (sweep.rounds == 0) return set_cs_asi_ctra(sweep.clksel_orig);
+
+  /* The clock is selected at the normal rate, then both ends speed up */
+  if (!set_cs_asi_ctra(_clk)) return false;
+  if (_clk != UPDI_SET_UPDICLKSEL_4M) {
+    UPDI_USART.CTRLB = UPDI_USART_OFF;
+    UPDI_USART.BAUD = sweep_divisor(_clk);
+    UPDI_USART.CTRLB = UPDI_USART_ON | USART_RXMODE_CLK2X_gc;
+  }
+  if ((get_cs_asi_ctra() & UPDI_SET_UPDICLKSEL_bm) != _clk) return false;
+
+  uint16_t _lfsr = 0xACE1;
+  uint16_t _start = TIM::Ticks();
+  for (uint8_t r = 0; r < sweep.rounds; r++) {
+    uint16_t _seed = _lfsr;
+    wdt_reset();
+    uint8_t _len = sweep.length;
+
+    /* Write without ACK : each echo is still checked by the loopback */
+    if (!set_cs_ctra(sweep.gtval | UPDI_SET_RSD)) return false;
+    if (!send_repeat_header(sweep.addr, UPDI_ST | UPDI_DATA1, _len)) return false;
+    _ptr_shadow = -1;
+    do {
+      if (!SEND(sweep_next(_lfsr))) sweep.echo_errors++;
+    } while (--_len);
+
+    /* Read back and compare with the regenerated sequence */
+    if (!set_cs_ctra(sweep.gtval)) return false;
+    if (!send_repeat_header(sweep.addr, UPDI_LD | UPDI_DATA1, sweep.length)) return false;
+    _lfsr = _seed;
+    _len = sweep.length;
+    do {
+      uint8_t _data = RECV();
+      if (UPDI_LASTH & (USART_PERR_bm | USART_FERR_bm)) sweep.parity_errors++;
+      if (_data != sweep_next(_lfsr)) sweep.data_errors++;
+    } while (--_len);
+    _ptr_shadow = -1;
+  }
+  sweep.ticks = TIM::Ticks() - _start;
+
+  /* Back to the normal rate for the next cell */
+  if (!set_cs_ctra(UPDI_GTVAL)) return false;
+  if (!set_cs_asi_ctra(sweep.clksel_orig)) return false;
+  UPDI_USART.BAUD = UPDI_BAUD_RUN;
+  return true;
+}
+
+#endif
+
 /************************
  * UPDI control process *
  ************************/
 
+/* Expected time of each operation : a fault surfaces right after it */
+uint16_t UPDI::deadline (uint8_t updi_cmd) {
+  /* Transfer time is counted as 8 bytes per millisecond */
+  uint16_t _transfer = _CAPS16(JTAG2::packet.body[JTAG2::DATA_LENGTH])->word >> 3;
+  #ifdef ENABLE_ADDFEATS_WRITE_BEHIND
+  /* The page left programming is completed first */
+  if (NVM::write_pending) _transfer += TIMEOUT_PAGE_MS;
+  #endif
+  switch (updi_cmd) {
+    case UPDI_CMD_READ_MEMORY : {
+      return TIMEOUT_REGISTER_MS + _transfer;
+    }
+    case UPDI_CMD_WRITE_MEMORY : {
+      if (JTAG2::packet.body[JTAG2::DATA_ADDRESS + 3]) {
+        return TIMEOUT_REGISTER_MS + _transfer;
+      }
+      switch (JTAG2::packet.body[JTAG2::MEM_TYPE]) {
+        case JTAG2::MTYPE_SRAM :              // 0x20
+          return TIMEOUT_REGISTER_MS + _transfer;
+        case JTAG2::MTYPE_FLASH_PAGE :        // 0xB0
+        case JTAG2::MTYPE_XMEGA_APP_FLASH :   // 0xC0
+        case JTAG2::MTYPE_XMEGA_BOOT_FLASH :  // 0xC1
+          #ifdef ENABLE_ADDFEATS_WRITE_VERIFY
+          /* The page is read back as well */
+          return TIMEOUT_PAGE_MS + _transfer + _transfer;
+          #else
+          return TIMEOUT_PAGE_MS + _transfer;
+          #endif
+        case JTAG2::MTYPE_XMEGA_EEPROM :      // 0xC4
+        case JTAG2::MTYPE_EEPROM_PAGE :       // 0xB1
+        case JTAG2::MTYPE_EEPROM :            // 0x22
+          return TIMEOUT_EEPROM_MS + _transfer;
+      }
+      /* USERROW, FUSE and LOCK may go through a system reset */
+      return TIMEOUT_ERASE_MS;
+    }
+    case UPDI_CMD_ERASE : {
+      #ifdef ENABLE_ADDFEATS_REGION_ERASE
+      /* A whole section may be erased a page at a time */
+      if (JTAG2::packet.body[JTAG2::MEM_TYPE] == JTAG2::XMEGA_ERASE_APP
+       || JTAG2::packet.body[JTAG2::MEM_TYPE] == JTAG2::XMEGA_ERASE_BOOT)
+        return TIMEOUT_ERASE_MS << 2;
+      #endif
+      return TIMEOUT_ERASE_MS;
+    }
+    case UPDI_CMD_GO : {
+      return TIMEOUT_ACTIVATE_MS;
+    }
+    #if defined(ENABLE_ADDFEATS_MAILBOX) || defined(ENABLE_ADDFEATS_WAIT)
+    case UPDI_CMD_ATTACH : {
+      return TIMEOUT_ACTIVATE_MS;
+    }
+    #endif
+    #ifdef ENABLE_ADDFEATS_PREFETCH
+    case UPDI_CMD_PREFETCH : {
+      /* The packet holds the answer : the size is kept aside */
+      return TIMEOUT_REGISTER_MS + (NVM::prefetch_size >> 3);
+    }
+    #endif
+    #ifdef ENABLE_ADDFEATS_WRITE_BEHIND
+    case UPDI_CMD_COMPLETE : {
+      return TIMEOUT_REGISTER_MS + TIMEOUT_PAGE_MS;
+    }
+    #endif
+    #ifdef ENABLE_ADDFEATS_SWEEP
+    case UPDI_CMD_SWEEP : {
+      /* Recovery of the link plus both directions at the normal rate */
+      return TIMEOUT_ERASE_MS + (((uint16_t)sweep.rounds * sweep.length) >> 2);
+    }
+    #endif
+  }
+  /* Monitoring reads at most 256 bytes */
+  return TIMEOUT_REGISTER_MS + (256 >> 3);
+}
+
 bool UPDI::runtime (uint8_t updi_cmd) {
   volatile bool _result = false;
   if (setjmp(TIM::CONTEXT) == 0) {
-    TIM::Timeout_Start(800);
+    TIM::Timeout_Start(deadline(updi_cmd));
+    #ifdef ENABLE_ADDFEATS_WRITE_BEHIND
+    /* A failure is kept and answered by the next write */
+    NVM::write_complete();
+    #endif
+    #ifdef ENABLE_ADDFEATS_PREFETCH
+    /* Anything else may change what was read ahead */
+    if (updi_cmd != UPDI_CMD_READ_MEMORY && updi_cmd != UPDI_CMD_PREFETCH) NVM::prefetch_drop();
+    #endif
     switch (updi_cmd) {
       case UPDI_CMD_READ_MEMORY : {
         size_t byte_count = _CAPS16(JTAG2::packet.body[JTAG2::DATA_LENGTH])->word;
@@ -776,15 +1089,62 @@ bool UPDI::runtime (uint8_t updi_cmd) {
           #endif
         }
         else {
+          #ifdef ENABLE_ADDFEATS_REGION_ERASE
+          _result = NVM::region_erase();
+          #else
           /* AVRDUDE>=8.0 should not return an error on page erase. */
           _result = true;
+          #endif
         }
         break;
       }
       case UPDI_CMD_GO : {
-        _result = Target_Reset(true) && Target_Reset(false);
+        _result = Target_Release();
+        break;
+      }
+      #ifdef ENABLE_ADDFEATS_WATCH
+      case UPDI_CMD_WATCH : {
+        _result = MON::watch_sample();
+        break;
+      }
+      #endif
+      #ifdef ENABLE_ADDFEATS_MAILBOX
+      case UPDI_CMD_MAILBOX : {
+        _result = MON::mailbox_drain();
+        break;
+      }
+      #endif
+      #ifdef ENABLE_ADDFEATS_WAIT
+      case UPDI_CMD_WAIT : {
+        _result = MON::wait_poll();
+        break;
+      }
+      #endif
+      #if defined(ENABLE_ADDFEATS_MAILBOX) || defined(ENABLE_ADDFEATS_WAIT)
+      case UPDI_CMD_ATTACH : {
+        _result = attach();
+        break;
+      }
+      #endif
+      #ifdef ENABLE_ADDFEATS_SWEEP
+      case UPDI_CMD_SWEEP : {
+        _result = sweep_run();
+        break;
+      }
+      #endif
+      #ifdef ENABLE_ADDFEATS_PREFETCH
+      case UPDI_CMD_PREFETCH : {
+        _result = NVM::prefetch_run();
+        break;
+      }
+      #endif
+      #ifdef ENABLE_ADDFEATS_WRITE_BEHIND
+      case UPDI_CMD_COMPLETE : {
+        /* write_complete() has already run above */
+        _result = !NVM::write_error;
         break;
       }
+      #endif
     }
   }
   TIM::Timeout_Stop();
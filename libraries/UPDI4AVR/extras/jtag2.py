@@ -0,0 +1,256 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+"""
+JTAG2 dialect of UPDI4AVR for host side tools (Linux, standard library only)
+
+ @file jtag2.py
+ @author askn (K.Sato) multix.jp
+ @copyright Copyright (c) 2023 askn37 at github.com
+"""
+import array
+import fcntl
+import os
+import select
+import struct
+import termios
+import time
+
+# Master Commands IDs (see src/Prototypes.h)
+CMND_SIGN_OFF        = 0x00
+CMND_GET_SIGN_ON     = 0x01
+CMND_SET_PARAMETER   = 0x02
+CMND_GET_PARAMETER   = 0x03
+CMND_WRITE_MEMORY    = 0x04
+CMND_READ_MEMORY     = 0x05
+CMND_RESET           = 0x0B
+CMND_SET_DEVICE_DESC = 0x0C
+CMND_GET_SYNC        = 0x0F
+CMND_ENTER_PROGMODE  = 0x14
+CMND_LEAVE_PROGMODE  = 0x15
+CMND_XMEGA_ERASE     = 0x34
+CMND_SET_UPDI_PARAMS = 0x55
+CMND_FILL_MEMORY     = 0x64
+CMND_STREAM_MEMORY   = 0x65
+CMND_LOOPBACK        = 0x66
+
+# Slave Response IDs
+RSP_OK               = 0x80
+RSP_PARAMETER        = 0x81
+RSP_MEMORY           = 0x82
+RSP_SIGN_ON          = 0x86
+RSP_FAILED           = 0xA0
+RSP_ILLEGAL_VALUE    = 0xA6
+
+# Parameters
+PAR_EMU_MODE         = 0x03
+PAR_BAUD_RATE        = 0x05
+PAR_VTARGET          = 0x06
+
+# Memory types
+MTYPE_SRAM           = 0x20
+MTYPE_EEPROM         = 0x22
+MTYPE_FLASH_PAGE     = 0xB0
+MTYPE_FUSE_BITS      = 0xB2
+MTYPE_LOCK_BITS      = 0xB3
+MTYPE_XMEGA_EEPROM   = 0xC4
+MTYPE_XMEGA_USERSIG  = 0xC5
+
+MESSAGE_START        = 0x1B
+TOKEN                = 0x0E
+STREAM_MARK          = 0x06
+EVENT_SEQNUM         = 0xFFFF
+
+# PAR_BAUD_RATE index to bps (BAUD_TABLE in src/JTAG2.cpp, 0 = not supported)
+BAUD_TABLE = {
+     1: 2400,     2: 4800,     3: 9600,     4: 19200,    5: 38400,
+     6: 57600,    7: 115200,   8: 14400,    9: 153600,  10: 230400,
+    11: 460800,  12: 921600,  13: 128000,  14: 256000,  17: 150000,
+    18: 200000,  19: 250000,  20: 300000,  21: 400000,  22: 500000,
+    23: 600000,  24: 666666,  25: 1000000, 26: 1500000, 27: 2000000,
+    28: 3000000,
+}
+BAUD_INDEX = {bps: index for index, bps in BAUD_TABLE.items()}
+
+# Linux termios2 for rates without a Bnnn constant
+_TCGETS2 = 0x802C542A
+_TCSETS2 = 0x402C542B
+_BOTHER  = 0o010000
+_CBAUD   = 0o010017
+
+
+class Jtag2Error(Exception):
+    pass
+
+
+def crc16(data, crc=0xFFFF):
+    """CRC-CCITT as _crc_ccitt_update() of avr-libc"""
+    for b in data:
+        b ^= crc & 0xFF
+        b = (b ^ (b << 4)) & 0xFF
+        crc = (((b << 8) | (crc >> 8)) ^ (b >> 4) ^ (b << 3)) & 0xFFFF
+    return crc
+
+
+class Link:
+    """One UPDI4AVR programmer on a serial port (or a pseudo-terminal)"""
+
+    def __init__(self, path, baud=19200, timeout=1.0):
+        self.path = path
+        self.timeout = timeout
+        self.seqnum = 0
+        self.fd = os.open(path, os.O_RDWR | os.O_NOCTTY)
+        attr = termios.tcgetattr(self.fd)
+        attr[0] = 0                                           # iflag
+        attr[1] = 0                                           # oflag
+        attr[2] = termios.CS8 | termios.CREAD | termios.CLOCAL
+        attr[3] = 0                                           # lflag
+        attr[6][termios.VMIN] = 0
+        attr[6][termios.VTIME] = 0
+        termios.tcsetattr(self.fd, termios.TCSANOW, attr)
+        self.set_host_baud(baud)
+
+    def close(self):
+        if self.fd is not None:
+            os.close(self.fd)
+            self.fd = None
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *args):
+        self.close()
+
+    # --- serial line ---
+
+    def set_host_baud(self, bps):
+        """Returns False when the host adapter cannot use the rate"""
+        code = getattr(termios, 'B%d' % bps, None)
+        try:
+            if code is not None:
+                attr = termios.tcgetattr(self.fd)
+                attr[4] = attr[5] = code
+                termios.tcsetattr(self.fd, termios.TCSADRAIN, attr)
+            else:
+                buf = array.array('B', bytes(44))
+                fcntl.ioctl(self.fd, _TCGETS2, buf, True)
+                flags = list(struct.unpack_from('4I', buf))
+                flags[2] = (flags[2] & ~_CBAUD) | _BOTHER
+                struct.pack_into('4I', buf, 0, *flags)
+                struct.pack_into('2I', buf, 36, bps, bps)
+                fcntl.ioctl(self.fd, _TCSETS2, buf)
+        except (OSError, termios.error):
+            return False
+        self.baud = bps
+        return True
+
+    def write(self, data):
+        view = memoryview(bytes(data))
+        while view:
+            n = os.write(self.fd, view)
+            view = view[n:]
+
+    def drain(self):
+        termios.tcdrain(self.fd)
+
+    def read(self, length, timeout=None):
+        deadline = time.monotonic() + (self.timeout if timeout is None else timeout)
+        data = bytearray()
+        while len(data) < length:
+            wait = deadline - time.monotonic()
+            if wait <= 0 or not select.select([self.fd], [], [], wait)[0]:
+                raise Jtag2Error('timeout after %d of %d bytes' % (len(data), length))
+            data += os.read(self.fd, length - len(data))
+        return bytes(data)
+
+    def discard(self, quiet=0.05):
+        """Drop received bytes until the line stays quiet"""
+        while select.select([self.fd], [], [], quiet)[0]:
+            if not os.read(self.fd, 4096):
+                break
+
+    # --- packets ---
+
+    def send(self, body, seqnum=None):
+        if seqnum is None:
+            seqnum = self.seqnum
+            self.seqnum = (self.seqnum + 1) & 0xFFFF
+            if self.seqnum == EVENT_SEQNUM:
+                self.seqnum = 0
+        head = struct.pack('<BHIB', MESSAGE_START, seqnum, len(body), TOKEN)
+        frame = head + bytes(body)
+        self.write(frame + struct.pack('<H', crc16(frame)))
+        return seqnum
+
+    def recv(self, timeout=None):
+        """Returns (seqnum, body) of the next packet"""
+        while self.read(1, timeout)[0] != MESSAGE_START:
+            pass
+        head = bytes([MESSAGE_START]) + self.read(7, timeout)
+        seqnum, size, token = struct.unpack_from('<HIB', head, 1)
+        if token != TOKEN or size > 532:
+            raise Jtag2Error('framing error')
+        rest = self.read(size + 2, timeout)
+        if crc16(head + rest) != 0:
+            raise Jtag2Error('CRC error')
+        return seqnum, rest[:size]
+
+    def command(self, body, timeout=None):
+        """Sends one request and returns the answer body, events are skipped"""
+        seqnum = self.send(body)
+        while True:
+            number, answer = self.recv(timeout)
+            if number == seqnum:
+                return answer
+
+    # --- common requests ---
+
+    def sign_on(self):
+        answer = self.command([CMND_GET_SIGN_ON])
+        if answer[0] != RSP_SIGN_ON:
+            raise Jtag2Error('sign-on refused : $%02X' % answer[0])
+        return answer
+
+    def sign_off(self):
+        try:
+            self.command([CMND_SIGN_OFF])
+        except Jtag2Error:
+            pass
+
+    def get_sync(self):
+        return self.command([CMND_GET_SYNC])[0] == RSP_OK
+
+    def set_parameter(self, param, value):
+        return self.command([CMND_SET_PARAMETER, param] + list(value))[0]
+
+    def get_parameter(self, param):
+        answer = self.command([CMND_GET_PARAMETER, param])
+        if answer[0] != RSP_PARAMETER:
+            raise Jtag2Error('parameter $%02X : $%02X' % (param, answer[0]))
+        return answer[1:]
+
+    def set_baud(self, index):
+        """Changes both ends, returns False when either end refuses the rate"""
+        bps, old = BAUD_TABLE[index], self.baud
+        if not self.set_host_baud(bps):
+            return False
+        self.set_host_baud(old)
+        if self.set_parameter(PAR_BAUD_RATE, [index]) != RSP_OK:
+            return False
+        # The answer comes at the old rate, then the firmware switches
+        self.set_host_baud(bps)
+        return True
+
+    def enter(self, reset=0):
+        """CMND_RESET activates the UPDI of the target once per session"""
+        return self.command([CMND_RESET, reset], timeout=5.0)[0] == RSP_OK
+
+    def read_memory(self, mem_type, addr, length):
+        answer = self.command(struct.pack('<BBII', CMND_READ_MEMORY, mem_type, length, addr))
+        if answer[0] != RSP_MEMORY:
+            raise Jtag2Error('read $%06X : $%02X' % (addr, answer[0]))
+        return answer[1:]
+
+    def write_memory(self, mem_type, addr, data):
+        answer = self.command(struct.pack('<BBII', CMND_WRITE_MEMORY, mem_type, len(data), addr) + bytes(data))
+        if answer[0] != RSP_OK:
+            raise Jtag2Error('write $%06X : $%02X' % (addr, answer[0]))
@@ -0,0 +1,277 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+"""
+Static cycle budget of the per byte hot paths in an avr-objdump listing
+
+ usage: updi4avr_cycles.py UPDI4AVR_FW634B.ino.attiny1626_10000000L.lst [-F 10000000]
+                           [-b 3000000] [-u 225000] [-p 'host:name=/regex/'] [-v]
+
+ The listing is the one of scripts/create_disassembler_listing.sh
+ (avr-objdump -S), as found under bootloaders/hex.
+
+ A path is given as LINE:NAME=TARGET.
+   LINE   host : 8N1, 10 bits a byte at -b
+          updi : 8E2, 12 bits a byte at -u
+   TARGET SYMBOL    one call of a function, from its entry to ret
+          /REGEX/   one turn of the loop around the source line that
+                    matches, as objdump prints it in the listing
+
+ The cost is the longest path through the code with the AVRxt timings
+ of tinyAVR and megaAVR. A short loop that only polls a flag is taken
+ as already satisfied, because it waits for the wire and not the CPU.
+ A path that costs more than one character time is marked OVER and
+ the exit status is 1.
+
+ @file updi4avr_cycles.py
+ @author askn (K.Sato) multix.jp
+ @copyright Copyright (c) 2023 askn37 at github.com
+"""
+import argparse
+import os
+import re
+import sys
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+import jtag2  # noqa: E402
+
+LINE_BITS = {'host': 10, 'updi': 12}
+
+DEFAULT_PATHS = [
+    'host:JTAG2 get header=/\\(int8_t .*\\*p\\+\\+ = get\\(\\)/',
+    'host:JTAG2 get body=/\\(int16_t .*\\*p\\+\\+ = get\\(\\)/',
+    'host:JTAG2 crc packet=/_crc = crc16_update\\(_crc, \\*q\\+\\+\\)/',
+    'host:JTAG2 crc answer=/_crc = crc16_update\\(_crc, \\*_q\\+\\+\\)/',
+    'host:JTAG2 put=/put\\(\\*_p\\+\\+\\)/',
+    'updi:UPDI::SEND=UPDI::SEND(unsigned char)',
+    'updi:UPDI::RECV=UPDI::RECV()',
+    'updi:UPDI::send_bytes=/SEND\\(\\*data\\+\\+\\)/',
+]
+
+# AVRxt clocks, the rest is 1
+CLOCKS = {
+    'adiw': 2, 'sbiw': 2, 'mul': 2, 'muls': 2, 'mulsu': 2,
+    'fmul': 2, 'fmuls': 2, 'fmulsu': 2,
+    'ld': 2, 'ldd': 2, 'lds': 3, 'lpm': 3, 'elpm': 3,
+    'sts': 2, 'pop': 2,
+    'rjmp': 2, 'ijmp': 2, 'eijmp': 2, 'jmp': 3,
+    'rcall': 2, 'icall': 2, 'eicall': 2, 'call': 3,
+    'ret': 4, 'reti': 4,
+}
+SKIPS = {'cpse', 'sbrc', 'sbrs', 'sbic', 'sbis'}
+JUMPS = {'rjmp', 'jmp'}
+CALLS = {'rcall', 'call'}
+RETURNS = {'ret', 'reti'}
+POLL_LENGTH = 4     # a loop this short is a busy wait
+
+RE_SECTION = re.compile(r'^Disassembly of section (\S+):')
+RE_SYMBOL = re.compile(r'^([0-9a-f]{8}) <(.+)>:$')
+RE_MARKER = re.compile(r'^(\S.*?):(\d+)(?: \(discriminator \d+\))?$')
+RE_INSN = re.compile(r'^\s+([0-9a-f]+):\t([0-9a-f ]+?)\s*\t([a-z]+)(?:\t(.*))?$')
+RE_TARGET = re.compile(r';\s*0x([0-9a-f]+)')
+
+
+class Insn:
+    __slots__ = ('addr', 'size', 'op', 'target', 'marker', 'symbol')
+
+    @property
+    def next(self):
+        return self.addr + self.size
+
+    def is_branch(self):
+        return self.op.startswith('br') and self.op != 'break'
+
+
+class Listing:
+
+    def __init__(self, path):
+        self.insns = {}
+        self.symbols = {}
+        self.markers = {}   # (file, line) : source text
+        section = symbol = marker = None
+        text = []
+        with open(path, errors='replace') as f:
+            for line in f:
+                line = line.rstrip('\n')
+                m = RE_SECTION.match(line)
+                if m:
+                    section = m.group(1)
+                    continue
+                if section != '.text':
+                    continue
+                m = RE_SYMBOL.match(line)
+                if m:
+                    symbol = m.group(2)
+                    self.symbols[symbol] = int(m.group(1), 16)
+                    marker = None
+                    continue
+                m = RE_INSN.match(line)
+                if m:
+                    if text and marker:
+                        self.markers.setdefault(marker, text[-1])
+                    text = []
+                    insn = Insn()
+                    insn.addr = int(m.group(1), 16)
+                    insn.size = len(m.group(2).split())
+                    insn.op = m.group(3)
+                    t = RE_TARGET.search(m.group(4) or '')
+                    insn.target = int(t.group(1), 16) if t else None
+                    insn.marker = marker
+                    insn.symbol = symbol
+                    self.insns[insn.addr] = insn
+                    continue
+                m = RE_MARKER.match(line)
+                if m and '/' in m.group(1):
+                    marker = (os.path.basename(m.group(1)), int(m.group(2)))
+                    text = []
+                elif line.strip() and not line.endswith('():'):
+                    text.append(line)
+
+    def clocks(self, insn):
+        return CLOCKS.get(insn.op, 1)
+
+    def loops(self, symbol):
+        """(head, edge) of every backward jump or branch in a function"""
+        found = []
+        for insn in self.insns.values():
+            if insn.symbol == symbol and insn.target is not None and insn.target <= insn.addr \
+                    and (insn.op in JUMPS or insn.is_branch()):
+                found.append((insn.target, insn.addr))
+        return found
+
+    def is_poll(self, head, edge):
+        return sum(1 for a in self.insns if head <= a <= edge) <= POLL_LENGTH
+
+    def longest(self, start, stop=None, low=None, high=None, memo=None, calls=None):
+        """Longest clocks from start to ret, or to the jump back to stop.
+        None when no path gets there. Backward jumps other than to stop are polls."""
+        if memo is None:
+            memo = {}
+        if calls is None:
+            calls = {}
+        if start in memo:
+            return memo[start]
+        memo[start] = None      # a cycle here is not a path
+        insn = self.insns.get(start)
+        if insn is None or (low is not None and not low <= start <= high):
+            return None
+        here = self.clocks(insn)
+        options = []
+
+        def follow(addr, extra=0):
+            if stop is not None and addr == stop:
+                options.append(extra)
+                return
+            if addr <= insn.addr:
+                return          # a poll, satisfied at once
+            rest = self.longest(addr, stop, low, high, memo, calls)
+            if rest is not None:
+                options.append(extra + rest)
+
+        if insn.op in RETURNS:
+            if stop is None:
+                options.append(0)
+        elif insn.op in JUMPS:
+            follow(insn.target)
+        elif insn.is_branch():
+            follow(insn.next)
+            follow(insn.target, 1)          # taken costs one more
+        elif insn.op in SKIPS:
+            follow(insn.next)
+            skipped = self.insns.get(insn.next)
+            if skipped:
+                follow(skipped.next, skipped.size // 2)
+        elif insn.op in CALLS and insn.target is not None and insn.target != insn.next:
+            callee = self.call(insn.target, calls)
+            if callee is not None:
+                follow(insn.next, callee)
+        else:
+            follow(insn.next)
+        memo[start] = None if not options else here + max(options)
+        return memo[start]
+
+    def call(self, entry, calls):
+        if entry not in calls:
+            calls[entry] = None
+            calls[entry] = self.longest(entry, calls=calls)
+        return calls[entry]
+
+    def function(self, symbol):
+        entry = self.symbols.get(symbol)
+        if entry is None:
+            return None, None
+        return self.longest(entry), 'entry $%04X' % entry
+
+    def loop(self, pattern):
+        """The innermost loop that is not a poll around the matching source line"""
+        regex = re.compile(pattern)
+        lines = {k for k, v in self.markers.items() if regex.search(v)}
+        if not lines:
+            return None, None
+        anchors = [i for i in self.insns.values() if i.marker in lines]
+        best = None
+        for symbol in {i.symbol for i in anchors}:
+            for head, edge in self.loops(symbol):
+                if self.is_poll(head, edge):
+                    continue
+                if not any(head <= i.addr <= edge for i in anchors if i.symbol == symbol):
+                    continue
+                if best is None or edge - head < best[1] - best[0]:
+                    best = (head, edge)
+        if best is None:
+            return None, None
+        head, edge = best
+        where = '%s:%d $%04X-$%04X' % (sorted(lines)[0] + (head, edge))
+        return self.longest(head, stop=head, low=head, high=edge), where
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[1].strip())
+    parser.add_argument('listing')
+    parser.add_argument('-F', '--f-cpu', type=int, help='F_CPU, else taken from the file name')
+    parser.add_argument('-b', '--baud', type=int, default=max(jtag2.BAUD_TABLE.values()),
+                        help='host rate, the highest of BAUD_TABLE by default')
+    parser.add_argument('-u', '--updi-baud', type=int, default=225000, help='UPDI_BAUD')
+    parser.add_argument('-p', '--path', action='append', default=[],
+                        help='LINE:NAME=SYMBOL or LINE:NAME=/REGEX/')
+    parser.add_argument('-n', '--no-default', action='store_true', help='only the paths of -p')
+    parser.add_argument('-v', '--verbose', action='store_true', help='show where each path is')
+    args = parser.parse_args()
+
+    f_cpu = args.f_cpu
+    if f_cpu is None:
+        m = re.search(r'_(\d+)L?\.lst$', args.listing)
+        f_cpu = int(m.group(1)) if m else 10000000
+    listing = Listing(args.listing)
+    rates = {'host': args.baud, 'updi': args.updi_baud}
+
+    paths = ([] if args.no_default else DEFAULT_PATHS) + args.path
+    print('F_CPU %dHz, host %dbps, UPDI %dbps' % (f_cpu, args.baud, args.updi_baud))
+    print('%-4s %-22s %7s %7s %7s' % ('line', 'path', 'cycles', 'budget', 'margin'))
+    over = 0
+    for spec in paths:
+        m = re.match(r'^(host|updi):([^=]+)=(.+)$', spec)
+        if not m:
+            parser.error('bad path : %s' % spec)
+        kind, name, target = m.groups()
+        if target.startswith('/') and target.endswith('/') and len(target) > 1:
+            cycles, where = listing.loop(target[1:-1])
+        else:
+            cycles, where = listing.function(target)
+        if cycles is None:
+            if args.path and spec in args.path:
+                print('%-4s %-22s %7s' % (kind, name, 'missing'))
+                over += 1
+            elif args.verbose:
+                print('%-4s %-22s %7s' % (kind, name, 'n/a'))
+            continue
+        budget = f_cpu * LINE_BITS[kind] // rates[kind]
+        mark = ' OVER' if cycles > budget else ''
+        over += bool(mark)
+        print('%-4s %-22s %7d %7d %+7d%s' % (kind, name, cycles, budget, budget - cycles, mark))
+        if args.verbose:
+            print('%27s %s' % ('', where))
+    return 1 if over else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
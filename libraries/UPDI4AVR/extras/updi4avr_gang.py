@@ -0,0 +1,305 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+"""
+Gang programming : one flash image on many UPDI4AVR programmers at once
+
+ usage: updi4avr_gang.py -f image.hex /dev/ttyUSB0 /dev/ttyUSB1 ... [-n 100] [-b 500000]
+        updi4avr_gang.py -f image.hex --simulate 4 -n 40
+
+ Each port gets its own worker thread. A board is claimed from the shared
+ count, then signed on, described with CMND_SET_UPDI_PARAMS, erased,
+ written and verified page by page, and released with CMND_SIGN_OFF.
+ The image is parsed into pages only once and shared by all workers.
+ An image container of updi4avr_image.py is used without any parsing.
+
+ @file updi4avr_gang.py
+ @author askn (K.Sato) multix.jp
+ @copyright Copyright (c) 2023 askn37 at github.com
+"""
+import argparse
+import os
+import pty
+import struct
+import sys
+import threading
+import time
+import tty
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+import jtag2  # noqa: E402
+import updi4avr_image  # noqa: E402
+
+
+# --- image ---
+
+def load_image(args):
+    """Returns [(mem_type, [(address, data, crc), ...]), ...] to be written in order"""
+    if updi4avr_image.is_image(args.file):
+        image = updi4avr_image.Image(args.file)
+        args.page, args.eeprom_page = image.flash_page, image.eeprom_page
+        # Blank flash pages are left to the chip erase
+        sections = []
+        for section in image.sections:
+            blank = b'\xFF' * section.page_size
+            sections.append((section.mem_type, [
+                (page.addr, blank if page.blank else page.data, page.crc) for page in section.pages
+                if not (page.blank and section.kind == updi4avr_image.KIND_FLASH)]))
+        return sections
+    memory = updi4avr_image.parse_ihex(args.file)
+    pages = updi4avr_image.make_pages(memory, args.page, args.base)
+    return [(jtag2.MTYPE_FLASH_PAGE, [(addr, data, jtag2.crc16(data)) for addr, data in pages
+                                      if data != b'\xFF' * args.page])]
+
+
+# --- one programmer ---
+
+class Station(threading.Thread):
+
+    def __init__(self, gang, path):
+        super().__init__(name=path, daemon=True)
+        self.gang = gang
+        self.path = path
+        self.good = 0
+        self.failed = 0
+        self.busy = 0.0
+
+    def log(self, message):
+        with self.gang.lock:
+            print('%-14s %s' % (self.path, message), flush=True)
+
+    def open(self):
+        """Signs on at 19200bps, the rate after every sign-off"""
+        link = self.link
+        link.set_host_baud(19200)
+        deadline = time.monotonic() + 10
+        while True:
+            link.discard()
+            try:
+                link.sign_on()
+                break
+            except jtag2.Jtag2Error:
+                if time.monotonic() > deadline:
+                    raise
+                time.sleep(0.5)
+        if self.gang.baud and not link.set_baud(jtag2.BAUD_INDEX[self.gang.baud]):
+            raise jtag2.Jtag2Error('%dbps is refused' % self.gang.baud)
+        if link.get_parameter(jtag2.PAR_EMU_MODE)[0] != 0x55:
+            raise jtag2.Jtag2Error('not an UPDI4AVR')
+        answer = link.command([jtag2.CMND_SET_UPDI_PARAMS] + list(self.gang.descriptor))
+        if answer[0] != jtag2.RSP_OK:
+            raise jtag2.Jtag2Error('CMND_SET_UPDI_PARAMS : $%02X' % answer[0])
+
+    def program(self):
+        """Returns None when no target answers, else raises on any failure"""
+        link = self.link
+        self.open()
+        if not link.enter(self.gang.reset):
+            link.sign_off()
+            return None
+        answer = link.command(struct.pack('<BBI', jtag2.CMND_XMEGA_ERASE, 0, 0), timeout=5.0)
+        if answer[0] != jtag2.RSP_OK:
+            raise jtag2.Jtag2Error('chip erase : $%02X' % answer[0])
+        for mem_type, pages in self.gang.sections:
+            for addr, data, crc in pages:
+                link.write_memory(mem_type, addr, data)
+        for mem_type, pages in self.gang.sections:
+            for addr, data, crc in pages:
+                if jtag2.crc16(link.read_memory(mem_type, addr, len(data))) != crc:
+                    raise jtag2.Jtag2Error('verify error at $%06X' % addr)
+        link.sign_off()
+        return True
+
+    def run(self):
+        try:
+            self.link = jtag2.Link(self.path)
+        except OSError as error:
+            self.log('cannot open : %s' % error)
+            return
+        try:
+            while True:
+                board = self.gang.claim()
+                if board is None:
+                    break
+                start = time.monotonic()
+                while True:
+                    try:
+                        done = self.program()
+                    except jtag2.Jtag2Error as error:
+                        self.failed += 1
+                        self.log('board %d failed : %s' % (board, error))
+                        self.link.sign_off()
+                        break
+                    if done:
+                        self.good += 1
+                        self.log('board %d done in %.2fs' % (board, time.monotonic() - start))
+                        break
+                    # No target yet, the operator is changing the board
+                    if self.gang.stopped():
+                        self.gang.unclaim()
+                        return
+                    time.sleep(self.gang.poll)
+                self.busy += time.monotonic() - start
+                if self.gang.hold:
+                    time.sleep(self.gang.hold)
+        finally:
+            self.link.close()
+
+
+class Gang:
+
+    def __init__(self, args, sections):
+        self.sections = sections
+        self.baud = args.baud
+        self.reset = 1 if args.reset else 0
+        self.poll = args.poll
+        self.hold = args.hold
+        self.count = self.remain = args.count
+        self.lock = threading.Lock()
+        self.halt = threading.Event()
+        # struct updi_device_descriptor : magic 'U', length, hvupdi_variant,
+        # nvmctrl_version (taken from the SIB later), flash and EEPROM page sizes
+        self.descriptor = struct.pack('<BBBBHB3s', 0x55, 8, ord(args.hv),
+                                      ord('0'), args.page, args.eeprom_page, bytes(3))
+
+    def claim(self):
+        with self.lock:
+            if self.halt.is_set() or self.remain == 0:
+                return None
+            self.remain -= 1
+            return self.count - self.remain
+
+    def unclaim(self):
+        with self.lock:
+            self.remain += 1
+
+    def stopped(self):
+        return self.halt.is_set()
+
+
+# --- simulated programmers ---
+
+class Simulator(threading.Thread):
+    """Answers the requests of the gang on a pseudo-terminal with a blank target"""
+
+    def __init__(self, line_bps=500000, page_ms=2.0):
+        super().__init__(daemon=True)
+        master, slave = pty.openpty()
+        tty.setraw(master)
+        self.path = os.ttyname(slave)
+        self.slave = slave
+        self.link = jtag2.Link.__new__(jtag2.Link)
+        self.link.fd, self.link.timeout, self.link.seqnum = master, 3600, 0
+        self.line_bps = line_bps
+        self.page_ms = page_ms
+        self.flash = {}
+
+    def wire(self, length):
+        time.sleep(length * 10 / self.line_bps)
+
+    def answer(self, body):
+        c = body[0]
+        if c == jtag2.CMND_GET_SIGN_ON:
+            return bytes([jtag2.RSP_SIGN_ON]) + bytes(28)
+        if c == jtag2.CMND_GET_PARAMETER:
+            return bytes([jtag2.RSP_PARAMETER, 0x55])
+        if c in (jtag2.CMND_SET_PARAMETER, jtag2.CMND_SET_UPDI_PARAMS,
+                 jtag2.CMND_RESET, jtag2.CMND_SIGN_OFF):
+            return bytes([jtag2.RSP_OK])
+        if c == jtag2.CMND_XMEGA_ERASE:
+            self.flash.clear()
+            time.sleep(0.01)
+            return bytes([jtag2.RSP_OK])
+        if c in (jtag2.CMND_WRITE_MEMORY, jtag2.CMND_READ_MEMORY):
+            _, length, addr = struct.unpack_from('<BII', body, 1)
+            if c == jtag2.CMND_WRITE_MEMORY:
+                for i, b in enumerate(body[10:10 + length]):
+                    self.flash[addr + i] = b
+                time.sleep(self.page_ms / 1000)
+                return bytes([jtag2.RSP_OK])
+            return bytes([jtag2.RSP_MEMORY]) + bytes(self.flash.get(addr + i, 0xFF) for i in range(length))
+        return bytes([jtag2.RSP_OK])
+
+    def run(self):
+        while True:
+            try:
+                seqnum, body = self.link.recv()
+            except (jtag2.Jtag2Error, OSError):
+                continue
+            self.wire(len(body) + 10)
+            response = self.answer(body)
+            self.wire(len(response) + 10)
+            self.link.send(response, seqnum)
+
+
+# --- main ---
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[1].strip())
+    parser.add_argument('ports', nargs='*')
+    parser.add_argument('-f', '--file', required=True,
+                        help='Intel HEX of the flash or an updi4avr_image.py container')
+    parser.add_argument('-n', '--count', type=int, default=0, help='boards to program, 0 = one per port')
+    parser.add_argument('-p', '--page', type=int, default=64, choices=(32, 64, 128, 512),
+                        help='flash page size of the target')
+    parser.add_argument('-e', '--eeprom-page', type=int, default=32, choices=(1, 8, 32, 64),
+                        help='EEPROM page size of the target')
+    parser.add_argument('-o', '--base', type=lambda v: int(v, 0), default=0x8000,
+                        help='flash address of the UPDI space, $8000 or $800000')
+    parser.add_argument('-b', '--baud', type=int, help='programming rate after sign-on')
+    parser.add_argument('-v', '--hv', default='0', choices='012', help='hvupdi_variant')
+    parser.add_argument('-r', '--reset', action='store_true', help='chip erase by key on a locked target')
+    parser.add_argument('--poll', type=float, default=1.0, help='seconds between looks for a board')
+    parser.add_argument('--hold', type=float, default=0.0, help='seconds to change the board')
+    parser.add_argument('--simulate', type=int, default=0, metavar='N',
+                        help='run against N simulated programmers on pseudo-terminals')
+    args = parser.parse_args()
+
+    if args.baud and args.baud not in jtag2.BAUD_INDEX:
+        parser.error('%d is not in BAUD_TABLE' % args.baud)
+    sections = load_image(args)
+    pages = sum(len(pages) for _, pages in sections)
+    if not pages:
+        parser.error('%s has no data' % args.file)
+
+    ports = list(args.ports)
+    for _ in range(args.simulate):
+        simulator = Simulator()
+        simulator.start()
+        ports.append(simulator.path)
+    if not ports:
+        parser.error('no ports')
+
+    args.count = args.count or len(ports)
+    gang = Gang(args, sections)
+    print('%d pages in %d sections on %d ports, %d boards' %
+          (pages, len(sections), len(ports), args.count), flush=True)
+
+    stations = [Station(gang, path) for path in ports]
+    start = time.monotonic()
+    for station in stations:
+        station.start()
+    try:
+        for station in stations:
+            while station.is_alive():
+                station.join(0.5)
+    except KeyboardInterrupt:
+        gang.halt.set()
+        print('stopping after the boards in progress', flush=True)
+        for station in stations:
+            station.join()
+    elapsed = time.monotonic() - start
+
+    print('%-14s %6s %6s %10s' % ('port', 'good', 'failed', 'sec/board'))
+    for station in stations:
+        boards = station.good + station.failed
+        print('%-14s %6d %6d %10.2f' % (station.path, station.good, station.failed,
+                                        station.busy / boards if boards else 0))
+    good = sum(s.good for s in stations)
+    failed = sum(s.failed for s in stations)
+    print('%d good, %d failed in %.1fs : %.0f boards/hour' %
+          (good, failed, elapsed, good * 3600 / elapsed if elapsed else 0))
+    return 1 if failed else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,250 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+"""
+Programming image container : pre-paged flash, EEPROM, user row and fuses
+
+ usage: updi4avr_image.py convert -f flash.hex [-e eeprom.hex] [-u userrow.hex]
+                                  [-F 0x1280=0x00,0x1281=0x54] [-p 64] [-E 32] [-U 32] -o image.u4i
+        updi4avr_image.py info image.u4i
+
+ The container is read through mmap, so a client finds every page by
+ offset and sends it without parsing anything per run.
+
+ Layout (all little endian)
+   header   16 bytes : "U4AI", version, sections, flash page, EEPROM page,
+                       reserved(2), CRC32 of everything after the header
+   section  16 bytes each : kind, JTAG2 memory type, page size, pages,
+                       page table offset, reserved(4)
+   page     20 bytes each : UPDI address, data offset, CRC16 of the page,
+                       flags, reserved, BLAKE2b-64 hash of the page
+   data     page blocks, each aligned to its page size in the file
+
+ The user row is one page of its own size (-U), never the flash page.
+ A page with PAGE_BLANK set is all $FF and has no data block (offset 0).
+ The CRC16 is the one of jtag2.crc16(), to verify a page read back.
+
+ @file updi4avr_image.py
+ @author askn (K.Sato) multix.jp
+ @copyright Copyright (c) 2023 askn37 at github.com
+"""
+import argparse
+import hashlib
+import mmap
+import os
+import struct
+import sys
+import zlib
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+import jtag2  # noqa: E402
+
+MAGIC = b'U4AI'
+VERSION = 1
+HEADER = struct.Struct('<4sBBHHHI')
+SECTION = struct.Struct('<BBHIII')
+PAGE = struct.Struct('<IIHBB8s')
+
+KIND_FLASH, KIND_EEPROM, KIND_USERROW, KIND_FUSE = 0, 1, 2, 3
+KIND_NAME = {KIND_FLASH: 'flash', KIND_EEPROM: 'eeprom', KIND_USERROW: 'userrow', KIND_FUSE: 'fuse'}
+KIND_MTYPE = {
+    KIND_FLASH:   jtag2.MTYPE_FLASH_PAGE,
+    KIND_EEPROM:  jtag2.MTYPE_XMEGA_EEPROM,
+    KIND_USERROW: jtag2.MTYPE_XMEGA_USERSIG,
+    KIND_FUSE:    jtag2.MTYPE_FUSE_BITS,
+}
+
+PAGE_BLANK = 0x01
+
+
+def page_hash(data):
+    return hashlib.blake2b(data, digest_size=8).digest()
+
+
+# --- Intel HEX ---
+
+def parse_ihex(path):
+    """Returns {address: byte} of an Intel HEX file"""
+    memory = {}
+    base = 0
+    with open(path) as f:
+        for number, line in enumerate(f, 1):
+            line = line.strip()
+            if not line:
+                continue
+            if line[0] != ':':
+                raise ValueError('%s:%d: not a record' % (path, number))
+            record = bytes.fromhex(line[1:])
+            if len(record) < 5 or len(record) != record[0] + 5 or sum(record) & 0xFF:
+                raise ValueError('%s:%d: broken record' % (path, number))
+            length, offset, kind = record[0], (record[1] << 8) | record[2], record[3]
+            data = record[4:4 + length]
+            if kind == 0:
+                for i, b in enumerate(data):
+                    memory[base + offset + i] = b
+            elif kind == 1:
+                break
+            elif kind == 2:
+                base = ((data[0] << 8) | data[1]) << 4
+            elif kind == 4:
+                base = ((data[0] << 8) | data[1]) << 16
+    return memory
+
+
+def make_pages(memory, page_size, base):
+    """Page aligned (address, data) list of every page the image touches"""
+    pages = []
+    for top in sorted({a & ~(page_size - 1) for a in memory}):
+        pages.append((base + top, bytes(memory.get(top + i, 0xFF) for i in range(page_size))))
+    return pages
+
+
+# --- container ---
+
+class Page:
+    __slots__ = ('addr', 'crc', 'flags', 'hash', 'data')
+
+    @property
+    def blank(self):
+        return bool(self.flags & PAGE_BLANK)
+
+
+class Section:
+    __slots__ = ('kind', 'mem_type', 'page_size', 'pages')
+
+    @property
+    def name(self):
+        return KIND_NAME.get(self.kind, '?')
+
+
+class Image:
+    """Read only view of a container, the page data are slices of the mapping"""
+
+    def __init__(self, path):
+        with open(path, 'rb') as f:
+            self.map = mmap.mmap(f.fileno(), 0, access=mmap.ACCESS_READ)
+        view = memoryview(self.map)
+        magic, version, count, self.flash_page, self.eeprom_page, _, crc = \
+            HEADER.unpack_from(view, 0)
+        if magic != MAGIC or version != VERSION:
+            raise ValueError('%s is not an image container' % path)
+        if zlib.crc32(view[HEADER.size:]) != crc:
+            raise ValueError('%s is broken' % path)
+        self.sections = []
+        for i in range(count):
+            section = Section()
+            section.kind, section.mem_type, section.page_size, pages, table, _ = \
+                SECTION.unpack_from(view, HEADER.size + i * SECTION.size)
+            section.pages = []
+            for j in range(pages):
+                page = Page()
+                page.addr, offset, page.crc, page.flags, _, page.hash = \
+                    PAGE.unpack_from(view, table + j * PAGE.size)
+                page.data = None if page.blank else view[offset:offset + section.page_size]
+                section.pages.append(page)
+            self.sections.append(section)
+
+    def section(self, kind):
+        for section in self.sections:
+            if section.kind == kind:
+                return section
+        return None
+
+
+def is_image(path):
+    with open(path, 'rb') as f:
+        return f.read(len(MAGIC)) == MAGIC
+
+
+def build(path, sections, flash_page, eeprom_page):
+    """sections : list of (kind, page_size, [(address, data), ...])"""
+    head = HEADER.size + SECTION.size * len(sections)
+    tables = []
+    offset = head
+    for kind, page_size, pages in sections:
+        tables.append(offset)
+        offset += PAGE.size * len(pages)
+    entries = bytearray()
+    blocks = bytearray()
+    for (kind, page_size, pages), table in zip(sections, tables):
+        for addr, data in pages:
+            flags = PAGE_BLANK if kind != KIND_FUSE and data == b'\xFF' * page_size else 0
+            where = 0
+            if not flags & PAGE_BLANK:
+                pad = -(offset + len(blocks)) % page_size
+                blocks += b'\xFF' * pad
+                where = offset + len(blocks)
+                blocks += data
+            entries += PAGE.pack(addr, where, jtag2.crc16(data), flags, 0, page_hash(data))
+    body = bytearray()
+    for (kind, page_size, pages), table in zip(sections, tables):
+        body += SECTION.pack(kind, KIND_MTYPE[kind], page_size, len(pages), table, 0)
+    body += entries + blocks
+    with open(path, 'wb') as f:
+        f.write(HEADER.pack(MAGIC, VERSION, len(sections), flash_page, eeprom_page, 0, zlib.crc32(body)))
+        f.write(body)
+
+
+# --- tool ---
+
+def convert(args):
+    sections = [(KIND_FLASH, args.page, make_pages(parse_ihex(args.flash), args.page, args.base))]
+    if args.eeprom:
+        sections.append((KIND_EEPROM, args.eeprom_page,
+                         make_pages(parse_ihex(args.eeprom), args.eeprom_page, args.eeprom_base)))
+    if args.userrow:
+        memory = parse_ihex(args.userrow)
+        over = [a for a in memory if a >= args.userrow_size]
+        if over:
+            print('%s : $%04X is past the user row of %d bytes' % (args.userrow, min(over), args.userrow_size),
+                  file=sys.stderr)
+            return 1
+        sections.append((KIND_USERROW, args.userrow_size,
+                         make_pages(memory, args.userrow_size, args.userrow_base)))
+    if args.fuse:
+        fuses = []
+        for item in args.fuse.split(','):
+            addr, value = item.split('=')
+            fuses.append((int(addr, 0), bytes([int(value, 0)])))
+        sections.append((KIND_FUSE, 1, sorted(fuses)))
+    build(args.output, sections, args.page, args.eeprom_page)
+    return info(argparse.Namespace(image=args.output))
+
+
+def info(args):
+    image = Image(args.image)
+    print('%s : flash page %d, EEPROM page %d' % (args.image, image.flash_page, image.eeprom_page))
+    for section in image.sections:
+        blank = sum(page.blank for page in section.pages)
+        first = section.pages[0].addr if section.pages else 0
+        print('  %-8s $%02X %4d bytes x %4d pages (%d blank) from $%06X' %
+              (section.name, section.mem_type, section.page_size, len(section.pages), blank, first))
+    return 0
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[1].strip())
+    sub = parser.add_subparsers(dest='action', required=True)
+    c = sub.add_parser('convert', help='Intel HEX files to a container')
+    c.add_argument('-f', '--flash', required=True, help='Intel HEX of the flash')
+    c.add_argument('-e', '--eeprom', help='Intel HEX of the EEPROM')
+    c.add_argument('-u', '--userrow', help='Intel HEX of the user row')
+    c.add_argument('-F', '--fuse', help='fuses as address=value,...')
+    c.add_argument('-p', '--page', type=int, default=64, choices=(32, 64, 128, 512),
+                   help='flash page size of the target')
+    c.add_argument('-E', '--eeprom-page', type=int, default=32, choices=(1, 8, 32, 64),
+                   help='EEPROM page size of the target')
+    c.add_argument('-U', '--userrow-size', type=int, default=32, choices=(32, 64, 512),
+                   help='user row size of the target, written as one page')
+    c.add_argument('-o', '--output', required=True)
+    c.add_argument('--base', type=lambda v: int(v, 0), default=0x8000,
+                   help='flash address of the UPDI space, $8000 or $800000')
+    c.add_argument('--eeprom-base', type=lambda v: int(v, 0), default=0x1400)
+    c.add_argument('--userrow-base', type=lambda v: int(v, 0), default=0x1300)
+    i = sub.add_parser('info', help='list the sections of a container')
+    i.add_argument('image')
+    args = parser.parse_args()
+    return convert(args) if args.action == 'convert' else info(args)
+
+
+if __name__ == '__main__':
+    sys.exit(main())
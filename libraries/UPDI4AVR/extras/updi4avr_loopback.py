@@ -0,0 +1,130 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+"""
+Host link qualification : sweeps every PAR_BAUD_RATE with CMND_LOOPBACK
+
+ usage: updi4avr_loopback.py /dev/ttyUSB0 [-n 20] [-s 256] [-p 0] [-r 230400,500000]
+
+ Requires the firmware built with ENABLE_ADDFEATS_LOOPBACK.
+
+ @file updi4avr_loopback.py
+ @author askn (K.Sato) multix.jp
+ @copyright Copyright (c) 2023 askn37 at github.com
+"""
+import argparse
+import os
+import struct
+import sys
+import time
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+import jtag2  # noqa: E402
+
+LOOP_ECHO, LOOP_STATS, LOOP_CLEAR = 0, 1, 2
+
+
+def pattern_bytes(pattern, length):
+    if pattern == 1:
+        return bytes(i & 0xFF for i in range(length))
+    if pattern == 2:
+        return bytes(0xAA if i & 1 else 0x55 for i in range(length))
+    if pattern == 3:
+        return bytes(0xFF if i & 1 else 0x00 for i in range(length))
+    return os.urandom(length)
+
+
+def stats(link):
+    answer = link.command([jtag2.CMND_LOOPBACK, LOOP_STATS])
+    if answer[0] != jtag2.RSP_PARAMETER:
+        raise jtag2.Jtag2Error('CMND_LOOPBACK is not supported')
+    return struct.unpack_from('<4H', answer, 1)
+
+
+def run_rate(link, count, size, pattern):
+    """Returns (good, host_errors, bytes_moved, seconds)"""
+    link.command([jtag2.CMND_LOOPBACK, LOOP_CLEAR])
+    good = errors = moved = 0
+    start = time.monotonic()
+    for _ in range(count):
+        payload = pattern_bytes(pattern, size)
+        try:
+            # Pattern 0 echoes the payload, the others are generated by the firmware
+            if pattern:
+                request = struct.pack('<BBHB', jtag2.CMND_LOOPBACK, LOOP_ECHO, size, pattern)
+            else:
+                request = struct.pack('<BBHB', jtag2.CMND_LOOPBACK, LOOP_ECHO, 0, 0) + payload
+            answer = link.command(request)
+            if answer[0] == jtag2.RSP_MEMORY and answer[1:] == payload:
+                good += 1
+            else:
+                errors += 1
+            moved += len(request) + len(answer) + 20
+        except jtag2.Jtag2Error:
+            errors += 1
+            link.discard()
+    return good, errors, moved, time.monotonic() - start
+
+
+def recover(link):
+    """The firmware watchdog restarts it at 19200bps when the link is lost"""
+    link.set_host_baud(19200)
+    deadline = time.monotonic() + 10
+    while time.monotonic() < deadline:
+        link.discard()
+        try:
+            link.sign_on()
+            return True
+        except jtag2.Jtag2Error:
+            time.sleep(0.5)
+    return False
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[1].strip())
+    parser.add_argument('port')
+    parser.add_argument('-n', '--count', type=int, default=20, help='echoes per rate')
+    parser.add_argument('-s', '--size', type=int, default=256, help='payload bytes (1 to 512)')
+    parser.add_argument('-p', '--pattern', type=int, default=0, choices=range(4),
+                        help='0 = random echo, 1 = counting, 2 = $55/$AA, 3 = $00/$FF')
+    parser.add_argument('-r', '--rates', help='comma separated bps, default is all of BAUD_TABLE')
+    args = parser.parse_args()
+
+    rates = sorted(jtag2.BAUD_TABLE.values())
+    if args.rates:
+        rates = [int(r) for r in args.rates.split(',')]
+
+    link = jtag2.Link(args.port)
+    link.sign_on()
+    print('%8s %7s %6s %6s %6s %8s %10s' %
+          ('bps', 'good', 'host', 'crc', 'frame', 'turn(us)', 'bytes/sec'))
+    try:
+        for bps in rates:
+            index = jtag2.BAUD_INDEX.get(bps)
+            if index is None:
+                print('%8d  not in BAUD_TABLE' % bps)
+                continue
+            try:
+                if not link.set_baud(index):
+                    print('%8d  not supported' % bps)
+                    continue
+                if not link.get_sync():
+                    raise jtag2.Jtag2Error('no sync')
+                good, errors, moved, elapsed = run_rate(link, args.count, args.size, args.pattern)
+                _, crc, frame, turn = stats(link)
+                print('%8d %3d/%-3d %6d %6d %6d %8d %10d' %
+                      (bps, good, args.count, errors, crc, frame, turn, moved / elapsed))
+            except jtag2.Jtag2Error as error:
+                print('%8d  link lost (%s)' % (bps, error))
+                if not recover(link):
+                    print('programmer does not answer any more')
+                    return 1
+                continue
+        link.set_baud(jtag2.BAUD_INDEX[19200])
+    finally:
+        link.sign_off()
+        link.close()
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,104 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+"""
+Pointer shadow check : full REPEAT blocks followed by the same address
+
+ usage: updi4avr_readback.py /dev/ttyUSB0 -a 0x3C00 [-b 500000]
+
+ A REPEAT of 256 bytes or 256 words is sent as a count of 0. The pointer
+ shadow of the firmware must still move past the block, or the next
+ access to the start address skips ST PTR and reaches the wrong memory.
+ Each block is read (and written) as a whole, then the same address is
+ accessed again with a short read and a short write, and both must
+ match a known pattern. The scratch area of target SRAM is overwritten,
+ 528 bytes from -a.
+
+ @file updi4avr_readback.py
+ @author askn (K.Sato) multix.jp
+ @copyright Copyright (c) 2023 askn37 at github.com
+"""
+import argparse
+import os
+import sys
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+import jtag2  # noqa: E402
+
+SHORT = 16
+
+
+def pattern(length, seed):
+    """Every 256 byte block differs from the others"""
+    return bytes(((i & 255) ^ (i >> 8) * 0x5A ^ seed) & 255 for i in range(length))
+
+
+def fill(link, addr, data):
+    """The block at addr is written last, as one REPEAT of 256"""
+    for i in reversed(range(0, len(data), 256)):
+        link.write_memory(jtag2.MTYPE_SRAM, addr + i, data[i:i + 256])
+
+
+def check(name, got, expect):
+    if got == expect:
+        print('%-34s ok' % name)
+        return 0
+    first = next(i for i in range(len(expect)) if got[i] != expect[i])
+    print('%-34s FAILED at +%d : $%02X expected $%02X' % (name, first, got[first], expect[first]))
+    return 1
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[1].strip())
+    parser.add_argument('port')
+    parser.add_argument('-a', '--addr', type=lambda v: int(v, 0), required=True,
+                        help='scratch address in target SRAM')
+    parser.add_argument('-b', '--baud', type=int, help='rate after sign-on')
+    args = parser.parse_args()
+
+    if args.baud and args.baud not in jtag2.BAUD_INDEX:
+        parser.error('%d is not in BAUD_TABLE' % args.baud)
+    link = jtag2.Link(args.port)
+    failed = 0
+    try:
+        link.sign_on()
+        if args.baud and not link.set_baud(jtag2.BAUD_INDEX[args.baud]):
+            print('%dbps is refused' % args.baud)
+            return 1
+        if not link.enter(1):
+            print('UPDI is not accessible')
+            return 1
+        addr = args.addr
+        for length, seed in ((256, 0x00), (512, 0xA5)):
+            image = pattern(length + SHORT, seed)
+            fill(link, addr, image)
+            # lds8 or lds16 with a REPEAT count of 0, then the start again
+            failed += check('read %d' % length, link.read_memory(jtag2.MTYPE_SRAM, addr, length),
+                            image[:length])
+            failed += check('read %d, then read %d' % (length, SHORT),
+                            link.read_memory(jtag2.MTYPE_SRAM, addr, SHORT), image[:SHORT])
+            # The same after a short write over the start
+            link.read_memory(jtag2.MTYPE_SRAM, addr, length)
+            mark = bytes(b ^ 0xFF for b in image[:SHORT])
+            link.write_memory(jtag2.MTYPE_SRAM, addr, mark)
+            failed += check('read %d, then write %d' % (length, SHORT),
+                            link.read_memory(jtag2.MTYPE_SRAM, addr, SHORT) +
+                            link.read_memory(jtag2.MTYPE_SRAM, addr + length, SHORT),
+                            mark + image[length:])
+        # sts8 with a REPEAT count of 0, then the start again
+        image = pattern(256 + SHORT, 0x3C)
+        fill(link, addr, image)
+        mark = bytes(b ^ 0xFF for b in image[:SHORT])
+        link.write_memory(jtag2.MTYPE_SRAM, addr, mark)
+        failed += check('write 256, then write %d' % SHORT,
+                        link.read_memory(jtag2.MTYPE_SRAM, addr, SHORT) +
+                        link.read_memory(jtag2.MTYPE_SRAM, addr + 256, SHORT),
+                        mark + image[256:])
+    finally:
+        link.sign_off()
+        link.close()
+    print('%d failed' % failed if failed else 'all passed')
+    return 1 if failed else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
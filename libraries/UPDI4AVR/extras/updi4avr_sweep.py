@@ -0,0 +1,69 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+"""
+UPDI link characterization : UPDICLKSEL x GTVAL matrix with CMND_UPDI_SWEEP
+
+ usage: updi4avr_sweep.py /dev/ttyUSB0 -a 0x3F00 [-l 64] [-n 16]
+
+ Requires the firmware built with ENABLE_ADDFEATS_SWEEP.
+ The scratch area of target SRAM is overwritten.
+
+ @file updi4avr_sweep.py
+ @author askn (K.Sato) multix.jp
+ @copyright Copyright (c) 2023 askn37 at github.com
+"""
+import argparse
+import os
+import struct
+import sys
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+import jtag2  # noqa: E402
+
+CMND_UPDI_SWEEP = 0x67
+CLKSEL_NAME = {3: '4MHz', 2: '8MHz', 1: '16MHz', 0: '32MHz'}
+GTVAL_CYCLES = [128, 64, 32, 16, 8, 4, 2]
+STATUS_NAME = {1: 'lost', 2: 'n/a'}
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[1].strip())
+    parser.add_argument('port')
+    parser.add_argument('-a', '--addr', type=lambda v: int(v, 0), required=True,
+                        help='scratch address in target SRAM')
+    parser.add_argument('-l', '--length', type=int, default=64, help='block length (1 to 255)')
+    parser.add_argument('-n', '--rounds', type=int, default=16, help='rounds per cell (1 to 255)')
+    parser.add_argument('-c', '--clksel', type=lambda v: int(v, 0), default=0x0E,
+                        help='UPDICLKSEL mask, bit 3 = 4MHz ... bit 0 = 32MHz')
+    parser.add_argument('-g', '--gtval', type=lambda v: int(v, 0), default=0x7F,
+                        help='GTVAL mask, bit 0 = 128 cycles ... bit 6 = 2 cycles')
+    args = parser.parse_args()
+
+    link = jtag2.Link(args.port)
+    try:
+        link.sign_on()
+        if not link.enter(1):
+            print('UPDI is not accessible')
+            return 1
+        request = struct.pack('<BHBBBB', CMND_UPDI_SWEEP, args.addr,
+                              args.length, args.rounds, args.clksel, args.gtval)
+        answer = link.command(request, timeout=600)
+        if answer[0] != jtag2.RSP_MEMORY:
+            print('sweep refused : $%02X' % answer[0])
+            return 1
+        print('%-6s %6s %6s %6s %6s %6s %10s' %
+              ('clock', 'guard', 'state', 'echo', 'parity', 'data', 'bytes/sec'))
+        for i in range(answer[1]):
+            clk, gt, status, echo, parity, data, rate = \
+                struct.unpack_from('<BBBHHHI', answer, 2 + i * 13)
+            print('%-6s %6d %6s %6d %6d %6d %10d' %
+                  (CLKSEL_NAME[clk], GTVAL_CYCLES[gt], STATUS_NAME.get(status, 'ok'),
+                   echo, parity, data, rate))
+    finally:
+        link.sign_off()
+        link.close()
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())